@@ -0,0 +1,136 @@
+/**
+ * \brief       Guest code profiler
+ * \file        code_profiler.hpp
+ * \copyright   LGPL v3
+ *
+ * Executed instructions and CPU cycles of the guest code, by PC
+ */
+#ifndef __CODE_PROFILER_HPP_
+#define __CODE_PROFILER_HPP_ 1
+
+#include "types.hpp"
+#include "vc_dll.hpp"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include <cstddef>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Profiler counters of a guest instruction
+ */
+struct CodeCounters {
+    DWord pc;        /// Address of the instruction
+    uint64_t insts;  /// Nº of times that was executed
+    uint64_t cycles; /// CPU cycles spent on it
+};
+
+/**
+ * Table of counters by PC, filled by a CPU when his code profiler is
+ * enabled. Is an open addressing hash table, so counting an instruction
+ * only costs a multiply and a few compares, and the table only grows with
+ * the number of different PCs executed.
+ */
+class CodeProfiler {
+public:
+
+	DECLDIR CodeProfiler();
+
+    /**
+     * Adds executed instructions and cycles to the counters of a PC
+     * \param pc Address of the instruction
+     * \param cycles CPU cycles spent
+     * \param insts Nº of executed instructions
+     */
+    void Add(DWord pc, unsigned cycles, unsigned insts = 1) {
+        CodeCounters& c = Find(pc);
+        c.insts  += insts;
+        c.cycles += cycles;
+        total_cycles += cycles;
+    }
+
+    /**
+     * Clears all the counters
+     */
+	DECLDIR void Clear();
+
+    /**
+     * Nº of different PCs with counters
+     */
+	DECLDIR std::size_t Size() const {
+        return used;
+    }
+
+    /**
+     * Sum of the cycles of all the PCs
+     */
+	DECLDIR uint64_t TotalCycles() const {
+        return total_cycles;
+    }
+
+    /**
+     * Counters of a PC (all zero if was never executed)
+     */
+	DECLDIR CodeCounters Get(DWord pc) const;
+
+    /**
+     * Counters of all the PCs, from more to less cycles
+     */
+	DECLDIR std::vector<CodeCounters> Sorted() const;
+
+    /**
+     * Disassembles the instruction at an address
+     */
+    typedef std::function<std::string(DWord)> Disassembler;
+
+    /**
+     * Writes the hottest instructions, a line for each one :
+     * pc  instructions  cycles  % of cycles  disassembly
+     * \param stream Stream were to write
+     * \param dis Disassembler of the CPU, like DisassemblyTR3200
+     * \param max_lines Max. Nº of instructions to write
+     */
+	DECLDIR void WriteReport(std::ostream& stream, const Disassembler& dis,
+	                         std::size_t max_lines = 50) const;
+
+private:
+
+    static DWord const INVALID = 0xFFFFFFFF; /// Tag of an empty entry
+
+    /**
+     * Entry of a PC. Inserts it if not exists
+     */
+    CodeCounters& Find(DWord pc) {
+        std::size_t i = Hash(pc);
+        while (table[i].pc != pc) {
+            if (table[i].pc == INVALID) {
+                return Insert(pc);
+            }
+            i = (i + 1) & (table.size() - 1);
+        }
+        return table[i];
+    }
+
+    std::size_t Hash(DWord pc) const {
+        return (pc * 2654435761u) >> (32 - bits);
+    }
+
+    /**
+     * Adds a new PC to the table, growing it if is half full
+     */
+    CodeCounters& Insert(DWord pc);
+
+    std::vector<CodeCounters> table; /// Hash table. Size is 2^bits
+    unsigned bits;                   /// Log2 of the table size
+    std::size_t used;                /// Nº of used entries
+    uint64_t total_cycles;           /// Sum of all the cycles
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __CODE_PROFILER_HPP_
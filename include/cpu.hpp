@@ -15,6 +15,7 @@ namespace trillek {
 namespace computer {
 
 class VComputer;
+class CodeProfiler;
 
 /**
  * Interface that must be implemented by any CPU that will be used by the
@@ -58,8 +59,10 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * @param n Number of cycles (default=1)
+     * @return Number of cycles executed. Less that n if a breakpoint or
+     * a watchpoint halts the CPU
      */
-    virtual void Tick (unsigned n = 1) = 0;
+    virtual unsigned Tick (unsigned n = 1) = 0;
 
     /**
      * Sends an interrupt to the CPU.
@@ -76,6 +79,17 @@ public:
      * \return True if is generating a new interrupt
      */
     virtual bool DoesTrap(Word& msg) = 0;
+
+    /**
+     * Checks if the CPU is sleeping, so it does nothing until gets an
+     * interrupt
+     *
+     * ICPU implementation returns false.
+     */
+    virtual bool isSleeping () const {
+        return false;
+    }
+
     /**
      * Writes a copy of CPU state in a chunk of memory pointer by ptr.
      * @param ptr Pointer were to write
@@ -92,6 +106,41 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size) = 0;
 
+    /**
+     * Invalidates any cached decoding of the instructions stored in a range
+     * of addresses. Called by the VComputer when a write hits a page marked
+     * as code (see VComputer::WatchCode)
+     *
+     * ICPU implementation does nothing.
+     * @param addr First modified address (24 bit)
+     * @param size Nº of modified bytes
+     */
+    virtual void InvalidateCode (DWord, std::size_t) {
+    }
+
+    /**
+     * Enables or disables the guest code profiler, that counts the executed
+     * instructions and CPU cycles of each PC. Enabling it clears the
+     * counters. When is disabled, there isn't any cost on the execution.
+     *
+     * ICPU implementation does nothing.
+     * @param enable True to enable the profiler
+     * @return True if the profiler is enabled
+     */
+    virtual bool SetCodeProfiling (bool) {
+        return false;
+    }
+
+    /**
+     * Counters of the guest code profiler
+     *
+     * ICPU implementation returns nullptr.
+     * @return The counters, or nullptr if the profiler is disabled
+     */
+    virtual const CodeProfiler* GetCodeProfile () const {
+        return nullptr;
+    }
+
 protected:
 
     computer::VComputer* vcomp; /// Ptr to the Virtual Computer
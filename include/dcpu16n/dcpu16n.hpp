@@ -11,9 +11,14 @@
 #include "../cpu.hpp"
 #include "../vcomputer.hpp"
 
+#include <memory>
+#include <vector>
+
 namespace trillek {
 namespace computer {
 
+class CodeProfiler;
+
 class DECLDIR DCPU16N : public ICPU {
 public:
 
@@ -41,8 +46,9 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * \param n Number of cycles (default=1)
+     * \return Number of cycles executed
      */
-    void Tick (unsigned n = 1);
+    unsigned Tick (unsigned n = 1);
 
     /**
      * Sends an interrupt to the CPU.
@@ -60,6 +66,11 @@ public:
 	 */
 	virtual bool DoesTrap(Word& msg);
 
+    /**
+     * Checks if the CPU is sleeping, waiting for an interrupt
+     */
+    virtual bool isSleeping () const;
+
     /**
      * Writes a copy of CPU state in a chunk of memory pointer by ptr.
      * @param ptr Pointer where to write
@@ -76,8 +87,191 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size);
 
+    /**
+     * Invalidates the predecoded instructions stored in a range of addresses
+     * \param addr First modified address (translated address)
+     * \param size Nº of modified bytes
+     */
+    virtual void InvalidateCode (DWord addr, std::size_t size);
+
+    /**
+     * Enables or disables the execution of whole instructions in a single
+     * step. When is disabled, or an instruction not fits on the cycles of
+     * a Tick call, the instruction goes phase by phase, cycle by cycle. The
+     * results and the used cycles are the same.
+     * \param enable True to execute whole instructions
+     */
+    void SetFastMode (bool enable) {
+        fast_mode = enable;
+    }
+
+    /**
+     * Returns true if whole instructions are executed in a single step
+     */
+    bool isFastMode () const {
+        return fast_mode;
+    }
+
+    /**
+     * Enables or disables the guest code profiler. Each cycle is counted
+     * on the instruction that is running
+     * \param enable True to enable the profiler
+     * \return True if the profiler is enabled
+     */
+    virtual bool SetCodeProfiling (bool enable);
+
+    /**
+     * Counters of the guest code profiler, or nullptr if is disabled
+     */
+    virtual const CodeProfiler* GetCodeProfile () const {
+        return profiler.get();
+    }
+
+    static unsigned const ICACHE_SIZE = 1024; /// Predecode cache entries
+
 protected:
 
+    /**
+     * Executes one or more CPU clock cycles, without profiling
+     * \param n Number of cycles
+     * \param until_fetch Returns when the actual instruction ends
+     * \return Number of cycles executed
+     */
+    unsigned RealTick (unsigned n, bool until_fetch = false);
+
+    /**
+     * Executes one or more CPU clock cycles, doing whole instructions when
+     * they end on these cycles. The rest goes to the phased engine
+     * \param n Number of cycles
+     * \return Number of cycles executed
+     */
+    unsigned FastTick (unsigned n);
+
+    /**
+     * Executes a whole instruction, if the instruction (or the interrupt)
+     * ends on the next n cycles. If not, only could fetch the opcode and
+     * let the phased engine do the rest of the cycle
+     * \param n Number of cycles that could be used
+     * \return Number of cycles used, or 0 if the phased engine must
+     * continue with the actual phase
+     */
+    unsigned ExecInstruction (unsigned n);
+
+    static Byte const OPD_REG     = 0;  /// REG
+    static Byte const OPD_REG_MEM = 1;  /// [REG]
+    static Byte const OPD_REG_NW  = 2;  /// [REG + nextword]
+    static Byte const OPD_LITERAL = 3;  /// Short literal
+    static Byte const OPD_POP     = 4;  /// [SP++]
+    static Byte const OPD_PUSH    = 5;  /// [--SP]
+    static Byte const OPD_PEEK    = 6;  /// [SP]
+    static Byte const OPD_PICK    = 7;  /// [SP + nextword]
+    static Byte const OPD_SP      = 8;  /// SP
+    static Byte const OPD_PC      = 9;  /// PC
+    static Byte const OPD_EX      = 10; /// EX
+    static Byte const OPD_NW_MEM  = 11; /// [nextword]
+    static Byte const OPD_NW      = 12; /// nextword
+    static Byte const OPD_NONE    = 13; /// Operand not used by the opcode
+
+    /**
+     * Opcode fields extracted by the decoder
+     */
+    struct DecodedInst {
+        DWord addr;  /// Translated address of the opcode (tag of the entry)
+        Word opcl;   /// OpCode word
+        Word a;      /// Register index or literal value of A operand
+        Word b;      /// Register index of B operand
+        Word wait;   /// Cycles waited by EXECW
+        Byte amode;  /// OPD_xxx mode of A operand
+        Byte bmode;  /// OPD_xxx mode of B operand
+        Byte fetch;  /// Cycles of next words and operand reads
+    };
+
+    static DWord const ICACHE_INVALID = 0xFFFFFFFF; /// Tag of an empty entry
+
+    std::vector<DecodedInst> icache; /// Predecode cache, indexed by translated address
+    DecodedInst uncached;            /// Decoded opcode that can't be cached
+    std::vector<Word> icache_pages;  /// Nº of cached opcodes of each page
+
+    /**
+     * Adds (or removes) an opcode from the counters of his pages
+     */
+    void CountCode(const DecodedInst& entry, int inc);
+
+    /**
+     * Decodes the opcode at a translated address. Only opcodes in RAM or ROM
+     * pages watched by the VComputer are cached
+     * \param bank EMU bank of the address
+     * \param addr Translated address of the opcode
+     * \return The decoded opcode
+     */
+    const DecodedInst& Decode (unsigned bank, DWord addr);
+
+    inline Word NextWord ();            /// Fetchs the next word of code
+
+    /**
+     * Reads an operand, like the UAREAD/UBREAD phases and the next phases
+     * \param mode OPD_xxx mode of the operand
+     * \param val Register index or literal value
+     * \param[out] addr Translated address of the operand, if is on memory
+     * \param[out] bank EMU bank of addr
+     * \return Value of the operand
+     */
+    inline Word ReadOperand (Byte mode, Word val, DWord& addr, unsigned& bank);
+
+    /**
+     * Executes the opcode (EXEC phase)
+     * \return True if must wait the cycles of the instruction (EXECW)
+     */
+    inline bool ExecOpCode ();
+
+    inline void WriteOperand ();        /// Writes the result (UBWRITE phase)
+    inline void WriteOperandMemory ();  /// Writes on memory (BCUWRITE phase)
+    void SkipOpCode ();                 /// Skips an instruction (EXECSKIP phase)
+    void PushJump ();                   /// Pushes PC and jumps (EXECJMP phase)
+    void ReturnFromInterrupt ();        /// Pops A and PC (EXECRFI phase)
+    void EnterInterrupt ();             /// Pushes PC and A, jumps to IA (INTERRUPT phase)
+
+    bool fast_mode; /// Executes whole instructions when is possible
+
+    /**
+     * Host pointers to the physical page mapped on each EMU bank
+     */
+    struct BankPtr {
+        DWord page;        /// Physical address of the page (the tag)
+        const Byte* read;  /// Pointer to read, or nullptr if must use the bus
+        Byte* write;       /// Pointer to write, or nullptr if must use the bus
+        unsigned size;     /// Nº of bytes that could be accessed by the pointers
+    };
+
+    BankPtr banks[16];     /// Translation cache of each EMU bank
+    unsigned banks_version; /// VComputer::BusVersion when the banks were mapped
+    unsigned aca_bank;     /// EMU bank of aca
+    unsigned bca_bank;     /// EMU bank of bca
+
+    void MapBank (unsigned bank); /// Gets the host pointers of a EMU bank
+    void MapBanks ();             /// Gets the host pointers of all EMU banks
+
+    /**
+     * Reads a word from a translated address, using the host pointer of
+     * the bank when is possible
+     * \param bank EMU bank of the address
+     * \param addr Translated address
+     * \param fetch True if is a code fetch
+     */
+    inline Word ReadWord (unsigned bank, DWord addr, bool fetch = false);
+
+    /**
+     * Writes a word on a translated address, using the host pointer of
+     * the bank when is possible
+     * \param bank EMU bank of the address
+     * \param addr Translated address
+     * \param val Value to write
+     */
+    inline void WriteWord (unsigned bank, DWord addr, Word val);
+
+    std::unique_ptr<CodeProfiler> profiler; /// Code profiler (if is enabled)
+    DWord profile_pc; /// Address of the instruction that is running
+
     // I/O Interface for opcodes
     Word IORead(Word);
     void IOWrite(Word, Word);
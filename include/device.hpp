@@ -125,6 +125,20 @@ public:
     virtual void Tick (unsigned, const double) {
     }
 
+    static const unsigned NO_EVENT = 0xFFFFFFFF; /// Never does an event
+
+    /**
+     * Device clock cycles until the device could generate an interrupt by
+     * himself, like the end of a job. The Virtual Computer uses it to jump
+     * over the time while the CPU is sleeping.
+     *
+     * IDevice implementation returns 1 for sync devices (any cycle could
+     * do it), and NO_EVENT for the others.
+     */
+    virtual unsigned NextEvent () const {
+        return IsSyncDev() ? 1 : NO_EVENT;
+    }
+
     /**
      * Checks if the device is trying to generate an interrupt
      *
@@ -148,6 +148,13 @@ public:
         return true;
     }
 
+    /**
+     * Device cycles until the current job ends and interrupts
+     */
+    virtual unsigned NextEvent () const {
+        return (state == STATE_CODES::BUSY) ? busyCycles + 1 : NO_EVENT;
+    }
+
     /*!
      * Executes N Device clock cycles.
      *
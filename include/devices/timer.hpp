@@ -39,6 +39,12 @@ public:
      */
     void Tick (unsigned n = 1, const double delta = 0);
 
+    /**
+     * Device clock cycles until a timer with interrupts enabled underflows
+     * @return Nº of cycles, or 0xFFFFFFFF if there isn't any
+     */
+    DWord NextEvent () const;
+
     /**
      * Checks if the device is trying to generate an interrupt
      * @param msg The interrupt message will be writen here
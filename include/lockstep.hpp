@@ -0,0 +1,172 @@
+/**
+ * \brief       Lockstep differential execution
+ * \file        lockstep.hpp
+ * \copyright   LGPL v3
+ *
+ * Runs two Virtual Computers at the same time, one with the reference CPU
+ * core and other with an optimized core, and checks that they do the same
+ */
+#ifndef __LOCKSTEP_HPP_
+#define __LOCKSTEP_HPP_ 1
+
+#include "types.hpp"
+#include "vc_dll.hpp"
+#include "vcomputer.hpp"
+
+#include <string>
+#include <cstddef>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * CPUs that the lockstep harness knows how to compare. Both computers must
+ * use the same CPU
+ */
+enum LockstepCPU {
+    LOCKSTEP_TR3200,  /// TR3200 (for example, interpreter against JIT)
+    LOCKSTEP_DCPU16N, /// DCPU-16N (for example, phased against fast mode)
+};
+
+/**
+ * First difference found between the two computers
+ */
+struct LockstepDivergence {
+    uint64_t ticks;        /// Base clock ticks executed when was found
+    uint64_t last_match;   /// Base clock ticks of the last check without differences
+    std::string what;      /// Register or RAM address that differs, and his values
+    DWord ref_pc;          /// Address of the next instruction of the reference
+    DWord test_pc;         /// Address of the next instruction of the tested one
+    std::string ref_inst;  /// Disassembly of the next instruction of the reference
+    std::string test_inst; /// Disassembly of the next instruction of the tested one
+};
+
+/**
+ * Lockstep differential execution harness. Ticks the two computers with the
+ * same slices of base clock ticks, and after each one compares the CPU
+ * states and the RAM. The RAM is compared incrementally : only the pages
+ * written since the last check (VComputer dirty tracking) are compared, so
+ * long runs cost near the same that running the two computers. Every some
+ * checks all the RAM is compared, so writes that skip the dirty tracking
+ * (a buggy fast path, or writes done directly on Ram()) are found too.
+ *
+ * The harness takes the dirty tracking of both computers. The devices must
+ * be deterministic (the RNG device gives other numbers on each computer).
+ */
+class Lockstep {
+public:
+
+    /**
+     * Prepares the lockstep execution. The computers must be powered on and
+     * with the same RAM, ROM and devices
+     * \param reference Computer with the reference CPU core
+     * \param tested Computer with the tested CPU core
+     * \param cpu CPU of both computers
+     * \param interval Base clock ticks between two checks
+     * \param full_interval Nº of checks between two compares of all the
+     * RAM, or 0 to compare only the dirty pages
+     */
+	DECLDIR Lockstep(VComputer& reference, VComputer& tested, LockstepCPU cpu,
+	                 unsigned interval = 1000, unsigned full_interval = 64);
+
+    /**
+     * Runs both computers, checking them after each interval
+     * \param ticks Nº of base clock ticks to run
+     * \return False if a divergence was found. The computers stop at the
+     * check that found it
+     */
+	DECLDIR bool Run(uint64_t ticks);
+
+    /**
+     * Compares the CPU states, and the RAM pages written since the last
+     * check (or all the RAM, on the first check and every full_interval
+     * checks)
+     * \param full Compares all the RAM
+     * \return False if a divergence was found
+     */
+	DECLDIR bool Check(bool full = false);
+
+    /**
+     * Returns true if a divergence was found
+     */
+	DECLDIR bool isDiverged() const {
+        return diverged;
+    }
+
+    /**
+     * First divergence found. Only valid if isDiverged()
+     */
+	DECLDIR const LockstepDivergence& Divergence() const {
+        return divergence;
+    }
+
+    /**
+     * Human readable report of the first divergence
+     */
+	DECLDIR std::string Report() const;
+
+    /**
+     * Base clock ticks executed by each computer
+     */
+	DECLDIR uint64_t Ticks() const {
+        return ticks;
+    }
+
+    /**
+     * Nº of checks done
+     */
+	DECLDIR uint64_t Checks() const {
+        return checks;
+    }
+
+private:
+
+    Lockstep(const Lockstep&);            // Not copyable
+    Lockstep& operator=(const Lockstep&);
+
+    /**
+     * Compares the CPU states
+     * \param[out] what Description of the first difference
+     * \return False if they differ
+     */
+    bool CompareState(std::string& what) const;
+
+    /**
+     * Compares the RAM
+     * \param full Compares all the RAM, or only the dirty pages
+     * \param[out] what Description of the first difference
+     * \return False if they differ
+     */
+    bool CompareRAM(bool full, std::string& what) const;
+
+    /**
+     * Fills the divergence, with the next instruction of each computer
+     * \param what Description of the difference
+     */
+    void Diverge(const std::string& what);
+
+    /**
+     * Address and disassembly of the next instruction of a computer
+     * \param vc The computer
+     * \param[out] inst Disassembly
+     * \return Address of the instruction
+     */
+    DWord NextInstruction(const VComputer& vc, std::string& inst) const;
+
+    VComputer& ref;      /// Computer with the reference core
+    VComputer& test;     /// Computer with the tested core
+    LockstepCPU cpu;     /// CPU of both computers
+    unsigned interval;   /// Base clock ticks between checks
+    unsigned full_interval; /// Checks between two compares of all the RAM
+    uint64_t ticks;      /// Base clock ticks executed
+    uint64_t checks;     /// Nº of checks done
+    uint64_t last_match; /// Ticks of the last check without differences
+    bool first_check;    /// The first check compares all the RAM
+    bool diverged;       /// A divergence was found ?
+    LockstepDivergence divergence; /// First divergence found
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __LOCKSTEP_HPP_
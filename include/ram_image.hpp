@@ -0,0 +1,84 @@
+/**
+ * \brief       Virtual Computer RAM image
+ * \file        ram_image.hpp
+ * \copyright   LGPL v3
+ *
+ * Read only snapshot of a Virtual Computer RAM, that could be mapped
+ * copy-on-write by many Virtual Computers
+ */
+#ifndef __RAM_IMAGE_HPP_
+#define __RAM_IMAGE_HPP_ 1
+
+#include "types.hpp"
+#include "vc_dll.hpp"
+
+#include <cstddef>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Snapshot of a RAM. On Linux the data lives in an anonymous memory file
+ * (memfd), so each view mapped with MapPrivate() shares the physical pages
+ * with the image until it writes on them. On other platforms, each view is
+ * a plain copy of the image.
+ */
+class RamImage {
+public:
+
+    /**
+     * Creates an image with a copy of a chunk of RAM
+     * \param data RAM contents
+     * \param size Size of the RAM in bytes
+     */
+	DECLDIR RamImage(const Byte* data, std::size_t size);
+
+	DECLDIR ~RamImage();
+
+    /**
+     * Size of the image in bytes
+     */
+	DECLDIR std::size_t Size() const {
+        return size;
+    }
+
+    /**
+     * Read only pointer to the image data
+     */
+	DECLDIR const Byte* Data() const {
+        return data;
+    }
+
+    /**
+     * Returns true if the image is ready to be mapped
+     */
+	DECLDIR bool isValid() const {
+        return data != nullptr;
+    }
+
+    /**
+     * Maps a private (copy-on-write) and writable view of the image
+     * \return Ptr to the view, or nullptr if fails
+     */
+	DECLDIR Byte* MapPrivate() const;
+
+    /**
+     * Releases a view returned by MapPrivate
+     * \param view Ptr to the view
+     */
+	DECLDIR void Unmap(Byte* view) const;
+
+private:
+
+    RamImage(const RamImage&);            // Not copyable
+    RamImage& operator=(const RamImage&);
+
+    std::size_t size; /// Image size
+    Byte* data;       /// Read only mapping (or copy) of the image data
+    int fd;           /// Memory file with the image data (-1 if not used)
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __RAM_IMAGE_HPP_
@@ -11,9 +11,15 @@
 #include "../cpu.hpp"
 #include "../vcomputer.hpp"
 
+#include <vector>
+#include <memory>
+
 namespace trillek {
 namespace computer {
 
+class TR3200Jit;
+class CodeProfiler;
+
 /**
  * Implementation of TR3200 CPU for Trillek's virtual computer
  */
@@ -49,8 +55,10 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * @param n Number of cycles (default=1)
+     * @return Number of cycles executed. Less that n if a breakpoint or
+     * a watchpoint halts the CPU
      */
-    void Tick (unsigned n = 1);
+    unsigned Tick (unsigned n = 1);
 
     /**
      * Sends an interrupt to the CPU.
@@ -68,6 +76,13 @@ public:
      */
     virtual bool DoesTrap(Word& msg);
 
+    /**
+     * Checks if the CPU is sleeping, waiting for an interrupt
+     */
+    virtual bool isSleeping () const {
+        return sleeping;
+    }
+
     /**
      * Writes a copy of CPU state in a chunk of memory pointer by ptr.
      * @param ptr Pointer were to write
@@ -84,7 +99,46 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size);
 
+    /**
+     * Invalidates the predecoded instructions stored in a range of addresses
+     * @param addr First modified address
+     * @param size Nº of modified bytes
+     */
+    virtual void InvalidateCode (DWord addr, std::size_t size);
+
+    /**
+     * Enables or disables the translation of basic blocks to native code.
+     * Only works on x86-64 Linux hosts. The results are the same that
+     * with the interpreter.
+     * @param enable True to use the translator
+     * @return True if the translator is being used
+     */
+    bool SetJIT (bool enable);
+
+    /**
+     * Returns true if the translator is being used
+     */
+    bool isJIT () const {
+        return jit != nullptr;
+    }
+
+    /**
+     * Enables or disables the guest code profiler. While is enabled, the
+     * translator is not used, so each instruction is counted on his PC
+     * @param enable True to enable the profiler
+     * @return True if the profiler is enabled
+     */
+    virtual bool SetCodeProfiling (bool enable);
+
+    /**
+     * Counters of the guest code profiler, or nullptr if is disabled
+     */
+    virtual const CodeProfiler* GetCodeProfile () const {
+        return profiler.get();
+    }
+
     static unsigned const TR3200_NGPRS = 16; /// Total number of CPU registers
+    static unsigned const ICACHE_SIZE = 1024; /// Predecode cache entries
 
 protected:
 
@@ -103,16 +157,153 @@ protected:
     bool skiping;   /// Is skiping an instruction ?
     bool sleeping;  /// Is sleping the CPU ?
 
+    /**
+     * Instruction fields extracted by the decoder
+     */
+    struct DecodedInst {
+        DWord pc;     /// Address of the instruction (tag of the cache entry)
+        DWord rn;     /// Literal value, or index of the Rn register
+        Byte opcode;  /// OpCode
+        Byte rd;      /// Index of the Rd register
+        Byte rs;      /// Index of the Rs register
+        Byte cycles;  /// Base cycles (including big literal fetch)
+        Byte length;  /// Instruction length in bytes (4 or 8)
+        Byte flags;   /// Instruction type and DEC_xxx flags
+        Byte handler; /// Index of the OpCode handler on the dispatch table
+    };
+
+    static Byte const DEC_P3          = 0x00; /// 3 parameters instruction
+    static Byte const DEC_P2          = 0x01; /// 2 parameters instruction
+    static Byte const DEC_P1          = 0x02; /// 1 parameter instruction
+    static Byte const DEC_NP          = 0x03; /// Instruction without parameters
+    static Byte const DEC_TYPE        = 0x03; /// Mask of instruction type
+    static Byte const DEC_LITERAL     = 0x04; /// Rn is a literal (M bit)
+    static Byte const DEC_BIG_LITERAL = 0x08; /// Literal is the next dword
+    static Byte const DEC_LIT_PENDING = 0x10; /// Big literal not fetched yet
+    static Byte const DEC_RN_REG      = 0x20; /// Uses the value of Rn register
+    static Byte const DEC_SYNC_FLAGS  = 0x40; /// Needs the real CF and OF
+    static Byte const DEC_BREAK       = 0x80; /// There is a breakpoint here
+
+    static DWord const ICACHE_INVALID = 0xFFFFFFFF; /// Tag of an empty entry
+
+    std::vector<DecodedInst> icache; /// Predecode cache, indexed by PC
+    std::vector<Word> icache_pages;  /// Nº of cached instructions of each page
+
+    /**
+     * Adds (or removes) an instruction from the counters of his pages
+     */
+    void CountCode (const DecodedInst& entry, int inc);
+
+    /**
+     * Decodes the instruction at an address
+     * Only instructions in RAM or ROM pages watched by the VComputer are
+     * cached. If not, the big literal is not fetched until is executed.
+     * @param addr Address of the instruction
+     * @return The decoded instruction
+     */
+    const DecodedInst& Decode (DWord addr);
+
+    DecodedInst uncached; /// Decoded instruction that can't be cached
+
+    static Byte const LAZY_NONE  = 0; /// CF and OF are in the FLAGS register
+    static Byte const LAZY_LOGIC = 1; /// CF = OF = 0
+    static Byte const LAZY_ADD   = 2; /// Of lazy_a + lazy_b + lazy_c
+    static Byte const LAZY_SUB   = 3; /// Of lazy_a - (lazy_b + lazy_c)
+    static Byte const LAZY_RSB   = 4; /// Like LAZY_SUB, with reversed operands
+
+    Byte lazy_flags; /// Last operation that changed CF and OF, if they
+                     // aren't in the FLAGS register yet
+    DWord lazy_a;    /// Operands of the last operation
+    DWord lazy_b;
+    DWord lazy_c;    /// Carry or borrow input
+
+    /**
+     * Stores the operands of the last operation, so CF and OF are only
+     * computed when somebody reads them
+     */
+    inline void SetLazyFlags (Byte op, DWord a, DWord b, DWord c, DWord rd);
+
+    /**
+     * Value of the FLAGS register, with the real CF and OF
+     */
+    DWord FlagsValue () const;
+
+    /**
+     * Puts the real CF and OF on the FLAGS register
+     */
+    void SyncFlags ();
+
     /**
      * Does the real work of executing a instrucction
      * @param Numvber of cycles tha requires to execute an instrucction
      */
     virtual unsigned RealStep ();
 
+    /**
+     * Interpreter. Threaded selects at compile time if runs only an
+     * instruction, or runs instructions while they begin before n cycles,
+     * jumping from each handler to the next one
+     * @param n Number of cycles that could be done (only if Threaded)
+     * @return Threaded : Number of cycles done. If not, number of cycles
+     * of the instruction
+     */
+    template <bool Threaded>
+    unsigned Interpret (unsigned n);
+
+    /**
+     * Ends an instruction of the threaded interpreter, doing his cycles
+     * like TickLoop does
+     * @param i Cycles done. Gets the cycles of the instruction
+     * @param n Number of cycles that could be done
+     * @return True if the next instruction begins before n cycles
+     */
+    bool Retire (unsigned& i, unsigned n);
+
     /**
      * Process if an interrupt is waiting
      */
     void ProcessInterrupt ();
+
+    /**
+     * Pushes a dword on the stack. Uses a single write if the stack is on
+     * plain RAM
+     * @param val Value to push
+     */
+    void PushDW (DWord val);
+
+    /**
+     * Executes N cycles. Profile selects at compile time the loop that
+     * counts each instruction, so the normal loop not pays for it
+     * @param n Number of cycles
+     * @return Number of cycles executed
+     */
+    template <bool Profile>
+    unsigned TickLoop (unsigned n);
+
+    std::unique_ptr<CodeProfiler> profiler; /// Code profiler (if is enabled)
+
+    std::unique_ptr<TR3200Jit> jit; /// Basic block translator (if is used)
+
+    /**
+     * Runs the translated block at PC, translating it if is needed
+     * @param max_cycles Nº of cycles that could be used
+     * @return Cycles used by the block, or 0 if the interpreter must do
+     * the next instruction
+     */
+    unsigned RunBlock (unsigned max_cycles);
+
+    /**
+     * Translates the basic block that begins at an address
+     * @param addr Address of the first instruction
+     */
+    void Translate (DWord addr);
+
+    /**
+     * Emits the native code of an instruction
+     * @param dec The decoded instruction
+     * @return False if the instruction can't be translated
+     */
+    bool EmitInst (const DecodedInst& dec);
 };
 
 /**
@@ -15,6 +15,9 @@
 
 #include "types.hpp"
 #include "vcomputer.hpp"
+#include "vcomputer_fleet.hpp"
+#include "code_profiler.hpp"
+#include "lockstep.hpp"
 
 // VM CPUs
 #include "tr3200/tr3200.hpp"
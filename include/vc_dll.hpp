@@ -0,0 +1,34 @@
+/**
+ * \brief       Virtual Computer macro for Windows DLLs
+ * \file        vc_dll.hpp
+ * \copyright   LGPL v3
+ *
+ * A little macro to put the necesary Visual Studio stff to generate correct
+ * DLLs
+ */
+
+#ifndef __VC_DLL_HPP_
+#define __VC_DLL_HPP_ 1
+
+// Note that to link against a dinamic lib on windows, would be necesary to
+// add a BUILD_DLL_VCOMPUTER definition to the proyect
+#ifdef BUILD_DLL_VCOMPUTER
+#  if defined(_MSC_VER)
+// DLL library on Windows, need special stuff
+
+#    if defined DLL_EXPORT
+#      define DECLDIR __declspec(dllexport)
+#    else
+#      define DECLDIR __declspec(dllimport)
+#    endif
+
+#  else // *nix not need something special
+#    define DECLDIR
+#  endif // if defined(_MSC_VER)
+
+#else // Static library, not need special stuff
+#  define DECLDIR
+#endif // BUILD_DLL_VCOMPUTER
+
+#endif // __VC_DLL_HPP_
+
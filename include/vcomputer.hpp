@@ -19,11 +19,17 @@
 #include "devices/rtc.hpp"
 #include "devices/nvram.hpp"
 #include "devices/beeper.hpp"
+#include "ram_image.hpp"
 
 #include <map>
+#include <string>
+#include <ostream>
 #include <set>
+#include <vector>
+#include <array>
 #include <memory>
 #include <cassert>
+#include <cstring>
 
 namespace trillek {
 namespace computer {
@@ -37,6 +43,16 @@ const unsigned EnumCtrlBlkSize = 20; /// Enumeration and Control registers blk s
 
 const unsigned BaseClock = 1000000; /// Computer Base Clock rate
 
+const unsigned BusPageShift = 12;                    /// Bus page size (4 KiB) as power of 2
+const std::size_t BusPageSize = 1 << BusPageShift;   /// Bus page size in bytes
+const unsigned BusPages = 0x1000000 >> BusPageShift; /// Nº of pages on the 24 bit address space
+const unsigned BusLineShift = 4;                     /// Sub-page line size (16 bytes) as power of 2
+const unsigned BusLines = BusPageSize >> BusLineShift; /// Nº of lines on a shared page
+const DWord IOPortBase = 0x110000;                   /// Address of the I/O port 0
+const unsigned IOPorts = 0x10000;                    /// Nº of I/O ports (16 bit port number)
+
+const unsigned MAX_ADDR_LISTENERS = 126; /// Max number of AddrListeners attached
+
 DECLDIR unsigned GetMajorVersion();      /// Library Major version
 DECLDIR unsigned GetMinorVersion();      /// Library Minor version
 DECLDIR unsigned GetPatchVersion();      /// Library Patch/Revision version
@@ -44,6 +60,25 @@ DECLDIR const char* GetBuildVersion();   /// Library "build" version
 
 class EnumAndCtrlBlk;
 
+/**
+ * Profiler counters of a bus page
+ */
+struct PageCounters {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t fetches;
+};
+
+/**
+ * Profiler counters of an AddrListener
+ */
+struct MMIOCounters {
+    DWord start;   /// First address listened by the AddrListener
+    DWord end;     /// Last address listened by the AddrListener
+    uint64_t reads;
+    uint64_t writes;
+};
+
 /**
  * To work the virtual computer have 3 different "clock ticks" :
  *  - base clock -> at BaseClock hz (1MHz)
@@ -63,6 +98,16 @@ public:
      */
 	DECLDIR VComputer(std::size_t ram_size = 128 * 1024);
 
+    /**
+     * Creates a Virtual Computer with a copy-on-write view of a RAM image
+     * as RAM, so the RAM is not allocated nor cleared. Used to spawn clones
+     * of a template computer (see CloneFrom) without paying the RAM.
+     * Powering on the computer not clears the RAM.
+     * \param image RAM image. His size is the RAM size. If is nullptr, the
+     * computer gets a cleared RAM of the default size
+     */
+	DECLDIR explicit VComputer(std::shared_ptr<const RamImage> image);
+
 	DECLDIR ~VComputer();
 
     /**
@@ -167,145 +212,229 @@ public:
 	DECLDIR unsigned Step(const double delta = 0);
 
     /**
-     * Executes N clock ticks
+     * Executes N clock ticks. While the CPU is sleeping, the time runs in
+     * big slices until the next timer or device event
      * \param n nubmer of base clock ticks, by default 1
      * \param delta Number of seconds since the last call
      */
 	DECLDIR void Tick(unsigned n = 1, const double delta = 0);
 
-	DECLDIR Byte ReadB(DWord addr) const {
-        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
-
-        if ( addr < ram_size ) {
-            // RAM address (0x000000-0x0FFFFF)
-            return ram[addr];
-        }
-
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            return rom[addr & 0x00FFFF];
-        }
-
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadB(addr);
-        }
+    /**
+     * Reads a Byte, Word or DWord from the computer address space.
+     * Multi-byte values are little endian, so on little endian hosts a RAM
+     * or ROM read is a single (unaligned) load. Reads that straddle the end
+     * of the RAM or the ROM are split in byte reads. Reads from pages with
+     * a read watchpoint go to ReadSlow.
+     * \param addr 24 bit address
+     * \return Value readed
+     */
+    template <typename T>
+    T Read(DWord addr) const {
+        return Load<T>(addr, false);
+    }
 
-        return 0;
-    } // ReadB
+    /**
+     * Reads an instruction (or a part of it) from the computer address
+     * space. Works like Read, but is accounted as a fetch by the profiler.
+     * \param addr 24 bit address
+     * \return Value readed
+     */
+    template <typename T>
+    T Fetch(DWord addr) const {
+        return Load<T>(addr, true);
+    }
 
-	DECLDIR Word ReadW(DWord addr) const {
+    /**
+     * Writes a Byte, Word or DWord to the computer address space.
+     * Multi-byte values are little endian, so on little endian hosts a RAM
+     * write is a single (unaligned) store. Writes that straddle the end of
+     * the RAM are split in byte writes. Writes to RAM pages with a listener,
+     * a watchpoint or not yet marked as dirty go to WriteSlow.
+     * \param addr 24 bit address
+     * \param val Value to write
+     */
+    template <typename T>
+    void Write(DWord addr, T val) {
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
-        size_t tmp;
 
-        if ( addr < ram_size-1 ) {
+        if ( addr + sizeof(T) <= ram_size ) {
             // RAM address
-            tmp = ( (size_t)ram ) + addr;
-            return ( (Word*)tmp )[0];
+            std::memcpy(ram + addr, &val, sizeof(T));
+            if ( (PageFlags(addr, sizeof(T)) & PAGE_TRAP_WRITE) == 0 ) {
+                return; // Nobody is listening or tracking these RAM page
+            }
         }
 
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            addr &= 0x00FFFF; // Dirty tricks with pointers
-            tmp   = ( (size_t)rom ) + addr;
-            return ( (Word*)tmp )[0];
-        }
+        WriteSlow(addr, val);
+    } // Write
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadW(addr);
-        }
+    /**
+     * Copies a block from the computer address space (DMA read).
+     * RAM and ROM chunks are copied with memcpy; the rest is read byte a
+     * byte from the AddrListeners. A read watchpoint on a chunk halts the
+     * computer, and LastWatchPoint gives the first address of the chunk.
+     * The chunks are split at the page boundaries, and the profiler counts
+     * a read on each page.
+     * \param addr 24 bit address
+     * \param dst Buffer were to write the data
+     * \param size Size of the block in bytes
+     */
+	DECLDIR void DmaRead(DWord addr, Byte* dst, std::size_t size) const;
 
-        return 0;
-    } // ReadW
+    /**
+     * Copies a block to the computer address space (DMA write).
+     * Chunks of plain RAM are copied with memcpy and update the dirty page
+     * tracking; the rest is written byte a byte to the AddrListeners. A
+     * write watchpoint on a chunk halts the computer, like DmaRead. The
+     * profiler counts a write on each page.
+     * \param addr 24 bit address
+     * \param src Data to write
+     * \param size Size of the block in bytes
+     */
+	DECLDIR void DmaWrite(DWord addr, const Byte* src, std::size_t size);
 
-	DECLDIR DWord ReadDW(DWord addr) const {
-        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
-        size_t tmp;
+	DECLDIR Byte ReadB(DWord addr) const {
+        return Read<Byte>(addr);
+    }
 
-        if ( addr < ram_size-3 ) {
-            // RAM address
-            tmp = ( (size_t)ram ) + addr;
-            return ( (DWord*)tmp )[0];
-        }
+	DECLDIR Word ReadW(DWord addr) const {
+        return Read<Word>(addr);
+    }
 
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            addr &= 0x00FFFF; // Dirty tricks with pointers
-            tmp   = ( (size_t)rom ) + addr;
-            return ( (DWord*)tmp )[0];
-        }
+	DECLDIR DWord ReadDW(DWord addr) const {
+        return Read<DWord>(addr);
+    }
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadDW(addr);
-        }
+	DECLDIR void WriteB(DWord addr, Byte val) {
+        Write<Byte>(addr, val);
+    }
 
-        return 0;
-    } // ReadDW
+	DECLDIR void WriteW(DWord addr, Word val) {
+        Write<Word>(addr, val);
+    }
 
-	DECLDIR void WriteB(DWord addr, Byte val) {
-        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
+	DECLDIR void WriteDW(DWord addr, DWord val) {
+        Write<DWord>(addr, val);
+    }
 
-        if (addr < ram_size) {
-            // RAM address
-            ram[addr] = val;
-        }
+    /**
+     * Checks if an access is to plain RAM, so a CPU could do it with a
+     * single Read or Write instead of byte a byte, and nobody would notice
+     * it : there isn't a listener, a write watchpoint or the profiler on
+     * his pages
+     * \param addr 24 bit address
+     * \param size Size of the access in bytes
+     */
+	DECLDIR bool isPlainRAM(DWord addr, std::size_t size) const {
+        addr = addr & 0x00FFFFFF;
+        return addr + size <= ram_size &&
+               (PageFlags(addr, size) & (PAGE_MMIO | PAGE_WATCH_W | PAGE_PROFILE)) == 0;
+    }
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteB(addr, val);
-        }
-    } // WriteB
+    /**
+     * Host pointer to the RAM or ROM of a bus page, so a CPU could read it
+     * directly while BusVersion not changes. Like Read, the listeners over
+     * RAM are ignored
+     * \param addr 24 bit address of the page
+     * \param[out] size Nº of bytes of the page that could be read
+     * \return nullptr if the reads of the page must go by the bus
+     * (watchpoints, profiler or outside of RAM and ROM)
+     */
+	DECLDIR const Byte* ReadPointer(DWord addr, std::size_t& size) const;
 
-	DECLDIR void WriteW(DWord addr, Word val) {
-        size_t tmp;
+    /**
+     * Host pointer to the RAM of a bus page, so a CPU could write it
+     * directly while BusVersion not changes
+     * \param addr 24 bit address of the page
+     * \param[out] size Nº of bytes of the page that could be written
+     * \return nullptr if the writes of the page must go by the bus
+     * (listeners, clean page with dirty tracking, watchpoints, etc)
+     */
+	DECLDIR Byte* WritePointer(DWord addr, std::size_t& size);
 
-        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
+    /**
+     * Version of the bus map. Changes when the accesses to some page could
+     * start to be trapped (new listeners, watchpoints, profiler, dirty
+     * tracking or cached code) or stop to be trapped (see UnwatchCode), or
+     * the RAM or ROM are replaced. The pointers given by
+     * ReadPointer and WritePointer are valid until it changes
+     */
+	DECLDIR unsigned BusVersion() const {
+        return bus_version;
+    }
 
-        if (addr < ram_size-1 ) {
-            // RAM address
-            tmp                 = ( (size_t)ram ) + addr;
-            ( (Word*)tmp )[0] = val;
-        }
-        // TODO What hapens when there is a write that falls half in RAM and
-        // half outside ?
-        // I actually forbid these cases to avoid buffer overun, but should be
-        // allowed and only use the apropiate portion of the data in the RAM.
-
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteW(addr, val);
+    /**
+     * Reads a word from a I/O port (address IOPortBase + port), like ReadW.
+     * The listener is taken from the port table, so the address decoder
+     * is skipped while nobody is watching or profiling the page. Lines
+     * shared by some listeners go by the address decoder
+     * \param port 16 bit port number
+     * \return Value read from the port
+     */
+    Word ReadPort(Word port) const {
+        const DWord addr = IOPortBase | port;
+        const Byte slot = port_lines[port >> BusLineShift];
+        if ( (page_flags[addr >> BusPageShift] & PAGE_TRAP_READ) != 0 ||
+                slot == BusLineShared ) {
+            return ReadSlow(addr, Word(), false);
         }
-    } // WriteW
+        const BusHandler& h = handlers[slot];
+        return (slot != 0 && h.range.start <= addr && addr <= h.range.end) ?
+               h.listener->ReadW(addr) : 0;
+    }
 
-	DECLDIR void WriteDW(DWord addr, DWord val) {
-        size_t tmp;
+    /**
+     * Writes a word to a I/O port (address IOPortBase + port), like WriteW.
+     * The listener is taken from the port table, like ReadPort
+     * \param port 16 bit port number
+     * \param val Value to write
+     */
+    void WritePort(Word port, Word val) {
+        const DWord addr = IOPortBase | port;
+        const Byte slot = port_lines[port >> BusLineShift];
+        if ( (page_flags[addr >> BusPageShift] & (PAGE_WATCH_W | PAGE_PROFILE)) != 0 ||
+                slot == BusLineShared ) {
+            WriteSlow(addr, val);
+            return;
+        }
+        const BusHandler& h = handlers[slot];
+        if (slot != 0 && h.range.start <= addr && addr <= h.range.end) {
+            h.listener->WriteW(addr, val);
+        }
+    }
 
-        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
+    /**
+     * Used by CPUs that cache decoded instructions. Checks if the code at
+     * an address could be cached, and if is in RAM, marks his pages so any
+     * write to them calls ICPU::InvalidateCode.
+     * \param addr 24 bit address of the code
+     * \param size Size of the code in bytes
+     * \return False if the code is not in RAM or ROM, or his pages are
+     * trapping reads (watchpoints or profiler), so can't be cached
+     */
+	DECLDIR bool WatchCode(DWord addr, std::size_t size);
 
-        if (addr < ram_size-3 ) {
-            // RAM address
-            tmp                  = ( (size_t)ram ) + addr;
-            ( (DWord*)tmp )[0] = val;
-        }
-        // TODO What hapens when there is a write that falls half in RAM and
-        // half outside ?
+    /**
+     * Used by CPUs that cache decoded instructions. Tells that the CPU not
+     * has cached code anymore on the pages of a range of addresses, so
+     * writes to them are not trapped again until WatchCode is called.
+     * \param addr 24 bit address of the first page
+     * \param size Size of the range in bytes
+     */
+	DECLDIR void UnwatchCode(DWord addr, std::size_t size);
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteDW(addr, val);
-        }
-    } // WriteDW
+    /**
+     * Drops all the instructions cached by the CPU. Must be called after
+     * writing code directly over Ram()
+     */
+	DECLDIR void FlushCodeCache();
 
     /**
      * Adds an AddrListener to the computer
+     * There is a hard cap of MAX_ADDR_LISTENERS (126) listeners, counting
+     * the embed devices and the Enumeration and Control block of each
+     * device. The address decoder indexes the listeners and the pages
+     * shared by some listeners with 7 bits, so the cap can't be bigger.
      * \param range Range of addresses that the listerner listens
      * \param listener AddrListener using these range
      * \return And ID oif the listener or -1 if can't add the listener
@@ -348,11 +477,152 @@ public:
     /**
      * Returns a pointer to the RAM for writing raw values to it
      * Use only for SetState methods or load a snapshot of the computer state
+     * (and call FlushCodeCache after it)
      */
 	DECLDIR Byte* Ram() {
         return ram;
     }
 
+    /**
+     * Takes a snapshot of the RAM, that could be shared copy-on-write by
+     * other computers (see LoadRAMImage and CloneFrom)
+     * \return The RAM image or nullptr if fails
+     */
+	DECLDIR std::shared_ptr<const RamImage> SnapshotRAM() const;
+
+    /**
+     * Replaces the RAM with a copy-on-write view of a RAM image. The image
+     * pages are shared until the computer writes on them.
+     * Powering on the computer not clears a RAM loaded from an image.
+     * \param image RAM image. Must have the same size that the RAM
+     * \return False if the image is nullptr, his size not matches or can't
+     * be mapped
+     */
+	DECLDIR bool LoadRAMImage(std::shared_ptr<const RamImage> image);
+
+    /**
+     * Makes this computer a clone of other computer : same ROM, RAM
+     * contents (shared copy-on-write), CPU state and power state.
+     * Devices and breakpoints are not cloned. Build the clone with the
+     * image constructor, so his RAM is never allocated nor cleared.
+     * \param other Template computer. Must have the same RAM size
+     * \param image Snapshot of the template RAM. If is nullptr, a new
+     * snapshot will be taken. Reusing the same image for many clones, shares
+     * the RAM pages between all of them.
+     * \return False if the RAM can't be cloned or the CPU state can't be set
+     */
+	DECLDIR bool CloneFrom(const VComputer& other,
+	                       std::shared_ptr<const RamImage> image = nullptr);
+
+    /**
+     * Backs the RAM with a memory mapped file, so the RAM persists between
+     * runs and could be inspected by other processes. The file is created
+     * if not exists, and grows to the RAM size if is smaller. The actual
+     * RAM contents are replaced by the file contents, that are loaded lazily
+     * by the OS when are accessed.
+     * Powering on the computer not clears a file backed RAM.
+     * \param filename File were to map the RAM
+     * \return False if the file can't be mapped or the platform not
+     * supports it
+     */
+	DECLDIR bool MapRAMFile(const std::string& filename);
+
+    /**
+     * Schedules a write of a file backed RAM to the disk
+     * \param wait If is true, waits to the end of the write
+     * \return False if the RAM is not file backed or fails
+     */
+	DECLDIR bool SyncRAMFile(bool wait = false);
+
+    /**
+     * Selects if the RAM is cleared when the computer is powered on.
+     * LoadRAMImage, CloneFrom and MapRAMFile disable it.
+     * \param clear True to clear the RAM on power on
+     */
+	DECLDIR void SetClearRAMOnPowerOn(bool clear) {
+        clear_ram = clear;
+    }
+
+    /**
+     * Enables or disables the tracking of RAM pages (of BusPageSize bytes)
+     * written since the last ClearDirtyPages call.
+     * Only the first write to a clean page is trapped, so the cost is near
+     * to zero. Writes done directly over Ram() are not tracked.
+     * Enabling it marks all pages as clean.
+     * \param enable True to enable tracking
+     */
+	DECLDIR void SetDirtyTracking(bool enable);
+
+    /**
+     * Returns true if the tracking of dirty RAM pages is enabled
+     */
+	DECLDIR bool isDirtyTracking() const {
+        return dirty_tracking;
+    }
+
+    /**
+     * Check if a RAM page has been written since the last ClearDirtyPages
+     * \param addr Any address of the page
+     * \return True if the page is dirty, or tracking is disabled
+     */
+	DECLDIR bool isDirtyPage(DWord addr) const;
+
+    /**
+     * Returns the base address of all dirty RAM pages
+     */
+	DECLDIR std::vector<DWord> GetDirtyPages() const;
+
+    /**
+     * Marks all RAM pages as clean
+     */
+	DECLDIR void ClearDirtyPages();
+
+    /**
+     * Enables or disables the bus profiler, that counts the reads, writes
+     * and instruction fetches done on each bus page, and the accesses to
+     * each AddrListener. When is disabled, there isn't any cost on the bus
+     * fast paths. Enabling it clears the counters.
+     * Each Read, Write or Fetch counts as one access, on the page of his
+     * first byte, also when is split in byte accesses. A DMA transfer
+     * counts as one access on each page that it touches. The AddrListener
+     * counters count the calls to the listener.
+     * \param enable True to enable the profiler
+     */
+	DECLDIR void SetProfiling(bool enable);
+
+    /**
+     * Returns true if the bus profiler is enabled
+     */
+	DECLDIR bool isProfiling() const {
+        return profiling;
+    }
+
+    /**
+     * Clears the profiler counters
+     */
+	DECLDIR void ClearProfile();
+
+    /**
+     * Profiler counters of each bus page, indexed by page number
+     * (address >> BusPageShift). Empty if the profiler never was enabled.
+     */
+	DECLDIR const std::vector<PageCounters>& GetPageProfile() const {
+        return profile_pages;
+    }
+
+    /**
+     * Profiler counters of the AddrListeners actually attached
+     */
+	DECLDIR std::vector<MMIOCounters> GetMMIOProfile() const;
+
+    /**
+     * Writes the profiler counters as CSV, a line for each page or
+     * AddrListener with some access :
+     * kind,start,end,reads,writes,fetches
+     * \param stream Stream were to write
+     */
+	DECLDIR void WriteProfileCSV(std::ostream& stream) const;
+
     /**
      * /brief Assing a function to be called when Beeper freq is changed
      * /param f_changed function to be called
@@ -398,17 +668,73 @@ public:
 	DECLDIR void ClearBreakPoints();
 
     /**
-     * Check if there isa breakpoint at an particular address
+     * Check if there isa breakpoint at an particular address. Only pages
+     * with a breakpoint look at the breakpoints list.
      * \param addr Address to verify
      * \return True if there is a breakpoint in these address
      */
-	DECLDIR bool isBreakPoint(DWord addr);
+	DECLDIR bool isBreakPoint(DWord addr) const {
+        addr = addr & 0x00FFFFFF;
+        return (page_flags[addr >> BusPageShift] & PAGE_BREAK) != 0 &&
+               breakpoints.find(addr) != breakpoints.end();
+    }
 
     /**
-     * Check if the Virtual Computer is halted by a breakpoint
+     * Called by the CPU before executing an instruction at a breakpoint.
+     * Halts the computer, except the first time after a Resume from
+     * these breakpoint, so the instruction can be executed.
+     * \param addr Address of the instruction
+     * \return True if the computer is halted
+     */
+	DECLDIR bool HitBreakPoint(DWord addr);
+
+    /**
+     * Kind of accesses that triggers a watchpoint
+     */
+    enum WatchMode {
+        WATCH_READ   = 1,
+        WATCH_WRITE  = 2,
+        WATCH_ACCESS = WATCH_READ | WATCH_WRITE,
+    };
+
+    /**
+     * Add a data watchpoint. When the watched addresses are accessed, the
+     * computer is halted like with a breakpoint, after the access.
+     * Only the bus pages with a watchpoint leave the fast path. DMA
+     * transfers trigger the watchpoints too.
+     * \param addr First watched address (24 bit)
+     * \param size Nº of watched bytes. The range ends at the end of the
+     * address space
+     * \param mode Accesses that triggers the watchpoint
+     */
+	DECLDIR void SetWatchPoint(DWord addr, std::size_t size = 1,
+	                           WatchMode mode = WATCH_ACCESS);
+
+    /**
+     * Erase the watchpoints that begin at an address
+     * \param addr First address of the watchpoint
+     */
+	DECLDIR void RmWatchPoint(DWord addr);
+
+    /**
+     * Remove all watchpoints
+     */
+	DECLDIR void ClearWatchPoints();
+
+    /**
+     * Address of the last access that triggered a watchpoint
+     */
+	DECLDIR DWord LastWatchPoint() const {
+        return last_watch;
+    }
+
+    /**
+     * Check if the Virtual Computer is halted by a breakpoint or watchpoint
      * \return True if a breakpoint happened
      */
-	DECLDIR bool isHalted();
+	DECLDIR bool isHalted() const {
+        return breaking;
+    }
 
     /**
      * Allows to continue if a Breakpoint happened
@@ -417,6 +743,199 @@ public:
 
 private:
 
+    friend class VComputerFleet;
+
+    /**
+     * Creates a Virtual Computer that uses an external chunk of memory as
+     * RAM. The chunk must be zeroed and outlive the computer.
+     * \param ram_size RAM size in BYTES
+     * \param ext_ram External RAM, or nullptr to allocate it
+     */
+    VComputer(std::size_t ram_size, Byte* ext_ram);
+
+    /**
+     * Address listener attached to the bus, and the range that it listens
+     */
+    struct BusHandler {
+        Range range;
+        AddrListener* listener;
+    };
+
+    static const Byte BusSubPage    = 0x80; /// Page slot points to a sub-page
+    static const unsigned BusMaxSubPages = 0x80; /// Sub-pages that a slot could index
+    static const Byte BusLineShared = 0xFF; /// Line shared by some listeners
+
+    static const Byte PAGE_MMIO        = 0x01; /// An AddrListener overlaps the page
+    static const Byte PAGE_DIRTY_TRACK = 0x02; /// Clean RAM page with tracking
+    static const Byte PAGE_WATCH_R     = 0x04; /// Read watchpoint on the page
+    static const Byte PAGE_WATCH_W     = 0x08; /// Write watchpoint on the page
+    static const Byte PAGE_PROFILE     = 0x10; /// Profiler counts the accesses
+    static const Byte PAGE_CODE        = 0x20; /// CPU has cached code of the page
+    static const Byte PAGE_BREAK       = 0x40; /// Breakpoint on the page
+
+    static const Byte PAGE_TRAP_READ   = PAGE_WATCH_R | PAGE_PROFILE;
+    static const Byte PAGE_TRAP_WRITE  = PAGE_MMIO | PAGE_DIRTY_TRACK | PAGE_WATCH_W |
+                                         PAGE_PROFILE | PAGE_CODE;
+
+    /**
+     * Flags of the pages touched by an access. Only for accesses that not
+     * wrap around the address space.
+     */
+    Byte PageFlags(DWord addr, std::size_t size) const {
+        return page_flags[addr >> BusPageShift] |
+               page_flags[(addr + size - 1) >> BusPageShift];
+    }
+
+    /**
+     * Search the AddrListener that listens an address
+     * A page slot points directly to the listener, or to a sub-page table
+     * of 16 byte lines when the page is shared by some small devices.
+     * \param addr 24 bit address
+     * \return The AddrListener or nullptr if nobody is listening there
+     */
+    AddrListener* FindListener(DWord addr) const {
+        Byte slot = page_handler[addr >> BusPageShift];
+        if (slot & BusSubPage) {
+            slot = sub_pages[slot & ~BusSubPage][(addr & (BusPageSize-1)) >> BusLineShift];
+            if (slot == BusLineShared) {
+                return ScanListener(addr);
+            }
+        }
+
+        if (slot != 0) {
+            const BusHandler& h = handlers[slot];
+            if (h.range.start <= addr && addr <= h.range.end) {
+                return h.listener;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Slow search of an AddrListener, used when some listeners share a line
+     */
+    AddrListener* ScanListener(DWord addr) const;
+
+    /**
+     * Implementation of Read and Fetch
+     */
+    template <typename T>
+    T Load(DWord addr, bool fetch) const {
+        addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
+
+        if ( addr + sizeof(T) <= ram_size ) {
+            // RAM address (0x000000-0x0FFFFF)
+            if ( (PageFlags(addr, sizeof(T)) & PAGE_TRAP_READ) == 0 ) {
+                T val;
+                std::memcpy(&val, ram + addr, sizeof(T));
+                return val;
+            }
+        } else {
+            const DWord rom_addr = addr - 0x100000;
+            if ( addr >= 0x100000 && rom_addr + sizeof(T) <= rom_size &&
+                    (PageFlags(addr, sizeof(T)) & PAGE_TRAP_READ) == 0 ) {
+                // ROM (0x100000-0x10FFFF)
+                T val;
+                std::memcpy(&val, rom + rom_addr, sizeof(T));
+                return val;
+            }
+        }
+
+        return ReadSlow(addr, T(), fetch);
+    } // Load
+
+    /**
+     * Bus reads that are not a plain RAM or ROM read : AddrListeners, and
+     * reads that straddle the end of RAM or ROM.
+     * The second parameter only selects the access width.
+     */
+    DECLDIR Byte  ReadSlow(DWord addr, Byte, bool fetch) const;
+    DECLDIR Word  ReadSlow(DWord addr, Word, bool fetch) const;
+    DECLDIR DWord ReadSlow(DWord addr, DWord, bool fetch) const;
+
+    /**
+     * Bus writes that are not a plain RAM write : AddrListeners, and writes
+     * that straddle the end of RAM.
+     */
+    DECLDIR void WriteSlow(DWord addr, Byte val);
+    DECLDIR void WriteSlow(DWord addr, Word val);
+    DECLDIR void WriteSlow(DWord addr, DWord val);
+
+    /**
+     * Generic implementation of ReadSlow and WriteSlow. Counts the access on
+     * the profiler and checks the watchpoints, and does it with BusLoad or
+     * BusStore
+     */
+    template <typename T>
+    T BusRead(DWord addr, bool fetch) const;
+
+    template <typename T>
+    void BusWrite(DWord addr, T val);
+
+    /**
+     * Does a bus access, without counting it on the page profiler nor
+     * checking the watchpoints. Accesses that straddle the end of RAM or
+     * ROM are split in byte accesses
+     */
+    template <typename T>
+    T BusLoad(DWord addr) const;
+
+    template <typename T>
+    void BusStore(DWord addr, T val);
+
+    /**
+     * Rebuilds the page table of the address decoder from the listeners
+     * container
+     * \return False if there is too many shared pages (BusMaxSubPages). The
+     * page table is left incomplete
+     */
+    bool RebuildAddrDecoder();
+
+    /**
+     * Gives a new bus version, so the CPU drops his pointers to the memory
+     */
+    void BusChanged();
+
+    /**
+     * Marks as dirty the RAM pages touched by a write
+     * \param addr RAM address
+     * \param size Size of the write in bytes
+     */
+    void MarkDirty(DWord addr, std::size_t size);
+
+    /**
+     * Halts the computer if an access hits a watchpoint
+     * \param addr Accessed address
+     * \param size Size of the access in bytes
+     * \param mode WATCH_READ or WATCH_WRITE
+     */
+    void CheckWatchPoint(DWord addr, std::size_t size, WatchMode mode) const;
+
+    /**
+     * Sets the watch flags of the page table from the watchpoints list
+     */
+    void RebuildWatchFlags();
+
+    /**
+     * Device clock cycles until the PIT or a device could do an interrupt
+     * \return Nº of cycles, or Device::NO_EVENT
+     */
+    unsigned NextEvent() const;
+
+    /**
+     * Runs the CPU and the devices N clock ticks, and sends to the CPU the
+     * interrupts raised at the end
+     * \param n nubmer of base clock ticks
+     * \param cpu_ticks Number of CPU cycles of these ticks
+     * \param delta Number of seconds of these ticks
+     */
+    void TickSlice(unsigned n, unsigned cpu_ticks, const double delta);
+
+    /**
+     * Releases the RAM with the apropiated method for his backing
+     */
+    void FreeRAM();
+
     bool is_on;                               /// Is PowerOn the computer ?
     Byte* ram;                              /// Computer RAM
     const Byte* rom;                        /// Computer ROM chip (could be
@@ -424,11 +943,35 @@ private:
                                               // VComputers)
     std::size_t ram_size;                     /// Computer RAM size
     std::size_t rom_size;                     /// Computer ROM size
+    enum RamBacking {
+        RAM_HEAP,   /// my_malloc
+        RAM_IMAGE,  /// Copy-on-write view of ram_image
+        RAM_FILE,   /// Shared mapping of a file
+        RAM_EXTERNAL, /// Chunk of a VComputerFleet arena
+    };
+    RamBacking ram_backing;                   /// How is allocated the RAM
+    std::shared_ptr<const RamImage> ram_image; /// Image mapped as RAM
+    bool clear_ram;                           /// Clear RAM on power on ?
+    bool dirty_tracking;                      /// Dirty tracking enabled ?
+    std::vector<bool> dirty_pages;            /// Dirty RAM pages bitmap
+
+    bool profiling;                                /// Profiler enabled ?
+    mutable std::vector<PageCounters> profile_pages; /// Counters by page
+    mutable std::map<const AddrListener*, std::pair<uint64_t, uint64_t> >
+        profile_mmio; /// Reads and writes by listener
     std::unique_ptr<ICPU> cpu;                /// Virtual CPU
     device_t devices[MAX_N_DEVICES];          /// Devices atached to the
                                               // virtual computer
     std::map<Range, AddrListener*> listeners; /// Container of AddrListeners
 
+    Byte page_handler[BusPages];       /// Address decoder page table
+    Byte page_flags[BusPages];         /// Per page flags bitmap (PAGE_xxx)
+    unsigned bus_version;              /// Version of the bus map (see BusVersion)
+    std::vector<BusHandler> handlers;  /// Listeners pointed by the page table
+    std::vector<std::array<Byte, BusLines> > sub_pages; /// Lines of shared pages
+    Byte port_lines[IOPorts >> BusLineShift]; /// Handler of each line of I/O
+                                              // ports (see ReadPort)
+
     Timer pit;     /// Programable Interval Timer
     RNG rng;       /// Random Number Generator
     RTC rtc;       /// Real Time Clock
@@ -436,12 +979,24 @@ private:
     Beeper beeper; /// Real Time Clock
 
     std::set<DWord> breakpoints; /// Breakpoints list
-    bool breaking;                 /// The Virtual Computer is halted in a
-                                   // BreakPoint ?
+    mutable bool breaking;         /// The Virtual Computer is halted in a
+                                   // BreakPoint or WatchPoint ?
+
+    /**
+     * Watched range of addresses
+     */
+    struct WatchPoint {
+        Range range;
+        WatchMode mode;
+    };
+    std::vector<WatchPoint> watchpoints; /// Watchpoints list
+    mutable DWord last_watch;            /// Address that triggered the last
+                                         // watchpoint
+    mutable bool watch_break;            /// Halted by a watchpoint ?
 
     DWord last_break; /// Address tof the last breakpoint finded
-    bool recover_break; /// Flag to know if a recovered the temporaly erases
-                        // break
+    bool skip_break;  /// Resumed from last_break, so must not halt again
+                      // before executing it
 };
 
 } // End of namespace computer
@@ -0,0 +1,94 @@
+/**
+ * \brief       Virtual Computer fleet
+ * \file        vcomputer_fleet.hpp
+ * \copyright   LGPL v3
+ *
+ * A set of Virtual Computers allocated in a single memory arena
+ */
+#ifndef __VCOMPUTER_FLEET_HPP_
+#define __VCOMPUTER_FLEET_HPP_ 1
+
+#include "types.hpp"
+#include "vcomputer.hpp"
+
+#include <cstddef>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Allocates N Virtual Computers and his RAMs in one big arena, instead of
+ * doing an allocation for each computer. On Linux, the arena uses huge
+ * pages when is possible and could be bound to a NUMA node.
+ * The computers objects are aligned to cache lines, and each RAM begins at
+ * a host page boundary.
+ */
+class VComputerFleet {
+public:
+
+    /**
+     * Creates a fleet of Virtual Computers
+     * \param count Nº of Virtual Computers
+     * \param ram_size RAM size of each Virtual Computer in BYTES
+     * \param numa_node Prefered NUMA node for the arena, or -1 for any node
+     */
+	DECLDIR VComputerFleet(unsigned count, std::size_t ram_size = 128 * 1024,
+	                       int numa_node = -1);
+
+	DECLDIR ~VComputerFleet();
+
+    /**
+     * Nº of Virtual Computers of the fleet
+     */
+	DECLDIR unsigned Size() const {
+        return count;
+    }
+
+    /**
+     * Gets a Virtual Computer of the fleet
+     * \param i Index of the Virtual Computer. Must be < Size()
+     */
+	DECLDIR VComputer& operator[](unsigned i) {
+        return *(VComputer*)(arena + i * vc_stride);
+    }
+
+	DECLDIR const VComputer& operator[](unsigned i) const {
+        return *(const VComputer*)(arena + i * vc_stride);
+    }
+
+    /**
+     * Returns true if the arena is backed by huge pages (explicit or
+     * transparent)
+     */
+	DECLDIR bool isHugePages() const {
+        return huge_pages;
+    }
+
+    /**
+     * Size of the arena in bytes
+     */
+	DECLDIR std::size_t ArenaSize() const {
+        return arena_size;
+    }
+
+    static const std::size_t CacheLineSize = 64;  /// Alignment of VComputers
+    static const std::size_t HostPageSize = 4096; /// Alignment of RAMs
+
+private:
+
+    VComputerFleet(const VComputerFleet&);            // Not copyable
+    VComputerFleet& operator=(const VComputerFleet&);
+
+    unsigned count;         /// Nº of Virtual Computers
+    std::size_t vc_stride;  /// Distance between two VComputer objects
+    std::size_t ram_stride; /// Distance between two RAMs
+    std::size_t arena_size; /// Size of the arena
+    Byte* arena;            /// VComputer objects, and after them, the RAMs
+    Byte* heap_block;       /// Heap block of the arena, if is not mapped
+    bool huge_pages;        /// Arena uses huge pages ?
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __VCOMPUTER_FLEET_HPP_
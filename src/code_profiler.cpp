@@ -0,0 +1,98 @@
+/**
+ * \brief       Guest code profiler
+ * \file        code_profiler.cpp
+ * \copyright   LGPL v3
+ *
+ * Executed instructions and CPU cycles of the guest code, by PC
+ */
+
+#include "code_profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace trillek {
+namespace computer {
+
+CodeProfiler::CodeProfiler() {
+    Clear();
+}
+
+void CodeProfiler::Clear() {
+    bits = 10;
+    CodeCounters empty = { INVALID, 0, 0 };
+    table.assign(std::size_t(1) << bits, empty);
+    used = 0;
+    total_cycles = 0;
+}
+
+CodeCounters CodeProfiler::Get(DWord pc) const {
+    for (std::size_t i = Hash(pc); table[i].pc != INVALID; i = (i + 1) & (table.size() - 1)) {
+        if (table[i].pc == pc) {
+            return table[i];
+        }
+    }
+    CodeCounters none = { pc, 0, 0 };
+    return none;
+}
+
+CodeCounters& CodeProfiler::Insert(DWord pc) {
+    if ( (used + 1) * 2 > table.size() ) {
+        // Rehash to a table of double size
+        std::vector<CodeCounters> old;
+        old.swap(table);
+        bits++;
+        CodeCounters empty = { INVALID, 0, 0 };
+        table.assign(std::size_t(1) << bits, empty);
+        for (const auto& c : old) {
+            if (c.pc != INVALID) {
+                std::size_t i = Hash(c.pc);
+                while (table[i].pc != INVALID) {
+                    i = (i + 1) & (table.size() - 1);
+                }
+                table[i] = c;
+            }
+        }
+    }
+
+    std::size_t i = Hash(pc);
+    while (table[i].pc != INVALID) {
+        i = (i + 1) & (table.size() - 1);
+    }
+    table[i].pc = pc;
+    used++;
+    return table[i];
+}
+
+std::vector<CodeCounters> CodeProfiler::Sorted() const {
+    std::vector<CodeCounters> list;
+    list.reserve(used);
+    for (const auto& c : table) {
+        if (c.pc != INVALID) {
+            list.push_back(c);
+        }
+    }
+    std::sort(list.begin(), list.end(), [] (const CodeCounters& a, const CodeCounters& b) {
+        return a.cycles > b.cycles || (a.cycles == b.cycles && a.pc < b.pc);
+    });
+    return list;
+}
+
+void CodeProfiler::WriteReport(std::ostream& stream, const Disassembler& dis,
+                               std::size_t max_lines) const {
+    const auto list = Sorted();
+    char buf[80];
+    std::snprintf(buf, sizeof(buf), "%-8s %12s %14s %7s  %s\n",
+                  "PC", "Insts", "Cycles", "%", "Instruction");
+    stream << buf;
+    for (std::size_t i = 0; i < list.size() && i < max_lines; i++) {
+        const CodeCounters& c = list[i];
+        const double percent = total_cycles ? 100.0 * c.cycles / total_cycles : 0;
+        std::snprintf(buf, sizeof(buf), "%06X   %12llu %14llu %6.2f%%  ", c.pc,
+                      (unsigned long long)c.insts, (unsigned long long)c.cycles, percent);
+        stream << buf << dis(c.pc) << "\n";
+    }
+}
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -9,6 +9,7 @@
 
 #include "dcpu16n/dcpu16n.hpp"
 #include "dcpu16n/dcpu16n_macros.hpp"
+#include "code_profiler.hpp"
 #include "vs_fix.hpp"
 
 #include <algorithm>
@@ -54,7 +55,24 @@ static const unsigned DCPU16N_cycletable[96] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-DCPU16N::DCPU16N(unsigned clock) : ICPU(), cpu_clock(clock) {
+// Extra cycles to get the A and B operands : next word fetch and memory read
+static const unsigned DCPU16N_acycles[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 0, 0, 0, 2, 2,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const unsigned DCPU16N_bcycles[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 2, 0, 0, 0, 2, 2,
+};
+
+DCPU16N::DCPU16N(unsigned clock) : ICPU(), fast_mode(true), profile_pc(0), cpu_clock(clock) {
+    DecodedInst empty = {};
+    empty.addr = ICACHE_INVALID;
+    icache.assign(ICACHE_SIZE, empty);
+    icache_pages.assign(BusPages, 0);
     this->Reset();
 }
 
@@ -65,71 +83,1047 @@ void DCPU16N::Reset()
 {
     int i;
 
-    // Generic initialization
-    std::fill_n(r, 8, 0);
-    pc = 0;
-    sp = 0;
-    ex = 0;
-    ia = 0;
+    // Generic initialization
+    std::fill_n(r, 8, 0);
+    pc = 0;
+    sp = 0;
+    ex = 0;
+    ia = 0;
+
+    for(i = 0; i < 16; i++) {
+        emu[i] = i << 12;
+    }
+
+    iqp = 0;
+    iqe = 0;
+    iqc = 0;
+
+    pwrdraw = 0;
+    phase   = 0;
+
+    wait_cycles = 0;
+    last_cycles = 0;
+
+    acu    = 0;
+    aca    = 0;
+    bcu    = 0;
+    bca    = 0;
+    opcl   = 0;
+    wrt    = 0;
+    fetchh = 0;
+
+    addradd  = false;
+    addrdec  = false;
+    bytemode = false;
+    bytehigh = false;
+    skip     = false;
+    fire     = false;
+    qint     = false;
+    // point EMU at ROM (page 0x100)
+    emu[0] = 0x00100000;
+
+    aca_bank = 0;
+    bca_bank = 0;
+    banks_version = 0; // Real bus versions begin at 1, so Tick maps the banks
+
+} // Reset
+
+void DCPU16N::MapBank(unsigned bank)
+{
+    BankPtr& b = banks[bank];
+    std::size_t size = 0;
+    b.page  = emu[bank];
+    b.read  = vcomp->ReadPointer(b.page, size);
+    b.write = b.read != nullptr ? vcomp->WritePointer(b.page, size) : nullptr;
+    b.size  = b.read != nullptr ? size : 0;
+}
+
+void DCPU16N::MapBanks()
+{
+    for(unsigned i = 0; i < 16; i++) {
+        MapBank(i);
+    }
+    banks_version = vcomp->BusVersion();
+}
+
+inline Word DCPU16N::ReadWord(unsigned bank, DWord addr, bool fetch)
+{
+    const BankPtr& b = banks[bank];
+    const DWord off = addr & 0x0fff;
+    if(b.read != nullptr && (addr & 0xfff000) == b.page && off + 1 < b.size) {
+        return ( ((Word)b.read[off + 1]) << 8 ) | (Word)b.read[off];
+    }
+    // Trapped page, or the word crosses the page : goes by the bus
+    if(fetch) {
+        return ( ((Word)vcomp->Fetch<Byte>(addr + 1)) << 8 )
+               |  (Word)vcomp->Fetch<Byte>(addr);
+    }
+    return ( ((Word)vcomp->ReadB(addr + 1)) << 8 )
+           |  (Word)vcomp->ReadB(addr);
+}
+
+inline void DCPU16N::WriteWord(unsigned bank, DWord addr, Word val)
+{
+    const BankPtr& b = banks[bank];
+    const DWord off = addr & 0x0fff;
+    if(b.write != nullptr && (addr & 0xfff000) == b.page && off + 1 < b.size) {
+        b.write[off]     = (Byte)(val & 0x0ff);
+        b.write[off + 1] = (Byte)(val >> 8);
+        return;
+    }
+    vcomp->WriteB(addr, (Byte)(val & 0x0ff));
+    vcomp->WriteB(addr + 1, (Byte)(val >> 8));
+}
+
+unsigned DCPU16N::Step()
+{
+    unsigned x = 0;
+    do {
+        Tick(1);
+        x++;
+    } while( (!fire) && (phase != 0) && (phase != DCPU16N_PHASE_SLEEP) );
+    last_cycles = x;
+    return x;
+}
+
+unsigned DCPU16N::Tick(unsigned n)
+{
+    if(vcomp->BusVersion() != banks_version) {
+        MapBanks();
+    }
+    if (!profiler) {
+        return fast_mode ? FastTick(n) : RealTick(n);
+    }
+
+    // Cycle by cycle, so each one goes to the instruction that is running
+    for (unsigned i = 0; i < n; i++) {
+        if (phase == DCPU16N_PHASE_SLEEP) {
+            RealTick(n - i); // Sleeping is not running code
+            break;
+        }
+        if (phase == DCPU16N_PHASE_OPFETCH) {
+            const DWord fetch_pc = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
+            RealTick(1);
+            if (phase == DCPU16N_PHASE_INTERRUPT) {
+                profiler->Add(profile_pc, 1, 0); // Enters an interrupt
+            }
+            else {
+                profile_pc = fetch_pc;
+                profiler->Add(profile_pc, 1);
+            }
+            continue;
+        }
+        RealTick(1);
+        profiler->Add(profile_pc, 1, 0);
+    }
+    return n;
+}
+
+bool DCPU16N::SetCodeProfiling(bool enable)
+{
+    if (!enable) {
+        profiler.reset();
+    }
+    else if (!profiler) {
+        profiler.reset(new CodeProfiler());
+    }
+    else {
+        profiler->Clear();
+    }
+    profile_pc = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
+    return profiler != nullptr;
+}
+
+inline bool DCPU16N::ExecOpCode()
+{
+    DWord cfa;
+    int32_t s32;
+    unsigned csc;
+
+    phase = DCPU16N_PHASE_OPFETCH;
+    if( (opcl & 0x001f) != 0 ) {
+        wrt = (opcl >> 5) & 0x1f;
+        switch(opcl & 0x001f) {
+        case 0x01: // SET (wb ra)
+            bcu = acu;
+            wrt |= 0x100;
+            break;
+
+        case 0x02: // ADD (rwb ra)
+            cfa  = bcu;
+            cfa += acu;
+            bcu  = (Word)cfa;
+            ex   = (Word)(cfa >> 16);
+            wrt |= 0x100;
+            break;
+
+        case 0x03: // SUB (rwb ra)
+            s32  = (int16_t)bcu;
+            s32 -= (int16_t)acu;
+            bcu  = (Word)s32;
+            ex   = (Word)(s32 >> 16);
+            wrt |= 0x100;
+            break;
+
+        case 0x04: // MUL (rwb ra)
+            cfa  = bcu;
+            cfa *= acu;
+            bcu  = (Word)cfa;
+            ex   = (Word)(cfa >> 16);
+            wrt |= 0x100;
+            break;
+
+        case 0x05: // MLI (rwb ra)
+            s32  = (int16_t)bcu;
+            s32 *= (int16_t)acu;
+            bcu  = (Word)s32;
+            ex   = (Word)(s32 >> 16);
+            wrt |= 0x100;
+            break;
+
+        case 0x06: // DIV (rwb ra)
+            if(acu) {
+                cfa = ( ( (DWord)bcu ) << 16 ) / acu;
+                ex  = (Word)cfa;
+                bcu = (Word)(cfa >> 16);
+            }
+            else {
+                bcu = 0;
+                ex  = 0;
+            }
+            wrt |= 0x100;
+            break;
+
+        case 0x07: // DVI (rwb ra)
+            if(acu) {
+                if( ( (int16_t)bcu) % ( (int16_t)acu ) ) {
+                    ex = ( ( (int32_t)bcu ) << 16 ) / ( (int16_t)acu );
+                }
+                else {
+                    ex = 0;
+                }
+                bcu = (Word)( ( (int16_t)bcu ) / ( (int16_t)acu ) );
+            }
+            else {
+                bcu = 0;
+                ex  = 0;
+            }
+            wrt |= 0x100;
+            break;
+
+        case 0x08: // MOD (rwb ra)
+            if(acu) {
+                bcu %= acu;
+            }
+            else {
+                bcu = 0;
+            }
+            wrt |= 0x100;
+            break;
+
+        case 0x09: // MDI (rwb ra)
+            if(acu) {
+                bcu = (Word)( ( (int16_t)bcu ) % ( (int16_t)acu ) );
+            }
+            else {
+                bcu = 0;
+            }
+            wrt |= 0x100;
+            break;
+
+        case 0x0a: // AND (rwb ra)
+            bcu &= acu;
+            wrt |= 0x100;
+            break;
+
+        case 0x0b: // BOR (rwb ra)
+            bcu |= acu;
+            wrt |= 0x100;
+            break;
+
+        case 0x0c: // XOR (rwb ra)
+            bcu ^= acu;
+            wrt |= 0x100;
+            break;
+
+        case 0x0d: // SHR (rwb ra)
+            cfa   = bcu << 16;
+            cfa >>= acu;
+            ex    = (Word)cfa;
+            bcu   = (Word)(cfa >> 16);
+            wrt  |= 0x100;
+            break;
+
+        case 0x0e: // ASR (rwb ra)
+            s32  = (int16_t)bcu;
+            ex   = (Word)( bcu << (16 - acu) );
+            bcu  = (Word)(s32 >> acu);
+            wrt |= 0x100;
+            break;
+
+        case 0x0f: // SHL (rwb ra)
+            cfa   = bcu;
+            cfa <<= acu;
+            ex    = (Word)(cfa >> 16);
+            bcu   = (Word)cfa;
+            wrt  |= 0x100;
+            break;
+
+        case 0x10: // IFB (rb ra)
+            if( (acu & bcu) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x11: // IFC (rb ra)
+            if( !(acu & bcu) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x12: // IFE (rb ra)
+            if( !(acu == bcu) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x13: // IFN (rb ra)
+            if( !(acu != bcu) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x14: // IFG (rb ra)
+            if( !(bcu > acu) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x15: // IFA (rb ra)
+            if( !( ( (int16_t)bcu ) > ( (int16_t)acu ) ) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x16: // IFL (rb ra)
+            if(!(bcu < acu)) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        case 0x17: // IFU (rb ra)
+            if( !( ( (int16_t)bcu ) < ( (int16_t)acu ) ) ) {
+                phase = DCPU16N_PHASE_MARKSKIP;
+            }
+            break;
+
+        //case 0x18:
+        //  break;
+        //case 0x19:
+        //  break;
+
+        case 0x1a: // ADX (rwb ra)
+            cfa  = bcu;
+            cfa += acu + ex;
+            ex   = (Word)(cfa >> 16);
+            bcu  = (Word)cfa;
+            wrt |= 0x100;
+            break;
+
+        case 0x1b: // SBX (rwb ra)
+            cfa  = bcu;
+            cfa  = cfa - acu + ex;
+            ex   = (Word)(cfa >> 16);
+            bcu  = (Word)cfa;
+            wrt |= 0x100;
+            break;
+
+        case 0x1c: // HWW (rb ra)
+            IOWrite(bcu, acu);
+            break;
+
+        case 0x1d: // HWR (rb wa)
+            bcu = IORead(bcu);
+            wrt = (opcl >> 10) | 0x100;
+            break;
+
+        case 0x1e: // STI (wb ra)
+            bcu   = acu;
+            r[6] += 2;
+            r[7] += 2;
+            wrt  |= 0x100;
+            break;
+
+        case 0x1f: // STD (wb ra)
+            bcu   = acu;
+            r[6] -= 2;
+            r[7] -= 2;
+            wrt  |= 0x100;
+            break;
+        }
+        if(wrt & 0x0100)
+            phase = DCPU16N_PHASE_UBWRITE;
+        csc = DCPU16N_cycletable[opcl & 0x001f];
+    }
+    else if((opcl & 0x03e0) != 0) {
+        wrt = (opcl >> 10);
+        bca = aca;
+        bca_bank = aca_bank;
+        switch((opcl >> 5) & 0x001f) {
+        case 0x01: // JSR (ra)
+            bcu   = pc;
+            phase = DCPU16N_PHASE_EXECJMP;
+            break;
+
+        case 0x02: // BSR (ra)
+            bcu   = pc;
+            phase = DCPU16N_PHASE_EXECJMP;
+            acu  += pc;
+            break;
+
+        //case 0x03:
+        //  break;
+        //case 0x04:
+        //  break;
+
+        case 0x05: // NEG (rwa)
+            wrt  |= 0x0100;
+            phase = DCPU16N_PHASE_UBWRITE;
+            bcu   = (Word)(-((int16_t)acu));
+            break;
+
+        //case 0x06:
+        //  break;
+
+        case 0x07: // HCF (^w^OMGFTWBBQa)
+            bcu  = (Word)pwrdraw;
+            fire = true;
+            break;
+
+        case 0x08: // INT (ra)
+            SendInterrupt(acu);
+            break;
+
+        case 0x09: // IAG (wa)
+            wrt  |= 0x0100;
+            phase = DCPU16N_PHASE_UBWRITE;
+            bcu   = ia;
+            break;
+
+        case 0x0a: // IAS (ra)
+            ia = acu;
+            break;
+
+        case 0x0b: // RFI (ra)
+            phase = DCPU16N_PHASE_EXECRFI;
+            break;
+
+        case 0x0c: // IAQ (ra)
+            qint = acu ? true : false;
+            break;
+
+        //case 0x0d:
+        //  break;
+        //case 0x0e:
+        //  break;
+        //case 0x0f:
+        //  break;
+
+        case 0x10: // MMW (ra)
+            emu[acu & 0x0f] = ((DWord)acu & 0xfff0) << 8;
+            MapBank(acu & 0x0f);
+            break;
+
+        case 0x11: // MMR (rwa)
+            wrt  |= 0x0100;
+            phase = DCPU16N_PHASE_UBWRITE;
+            bcu   = (emu[acu & 0x0f] >> 8) | (acu & 0x0f);
+            break;
+
+        //case 0x12:
+        //  break;
+        //case 0x13:
+        //  break;
+
+        case 0x14: // SXB (rwa)
+            wrt  |= 0x0100;
+            phase = DCPU16N_PHASE_UBWRITE;
+            bcu   = (-(acu & 0x80)) | (acu & 0x00ff);
+            break;
+
+        case 0x15: // SWP (rwa)
+            wrt  |= 0x0100;
+            phase = DCPU16N_PHASE_UBWRITE;
+            bcu   = ((acu >> 8) & 0xff) | ((acu << 8) & 0xFF00);
+            break;
+
+        //case 0x16:
+        //  break;
+        //case 0x17:
+        //  break;
+        //case 0x18:
+        //  break;
+        //case 0x19:
+        //  break;
+        //case 0x1a:
+        //  break;
+        //case 0x1b:
+        //  break;
+        //case 0x1c:
+        //  break;
+        //case 0x1d:
+        //  break;
+        //case 0x1e:
+        //  break;
+        //case 0x1f:
+        //  break;
+        } // switch
+        csc = DCPU16N_cycletable[32 + ( (opcl >> 5) & 0x001f )];
+    }
+    else {
+        wrt = 0x003f;
+        switch((opcl >> 10) & 0x001f) {
+        case 0x00: // HLT
+            bytemode = false;
+            if(ia && !qint) {
+                SendInterrupt(0);
+            }
+            phase = DCPU16N_PHASE_SLEEP;
+            break;
+
+        case 0x01: // SLP
+            bytemode = false;
+            phase    = DCPU16N_PHASE_SLEEP;
+            break;
+
+        //case 0x02:
+        //  break;
+        //case 0x03:
+        //  break;
+
+        case 0x04: // BYT (rv)
+            bytemode = !bytemode;
+            bytehigh = opcl & 0x8000 ? true : false;
+            break;
+
+        case 0x10: // SKP
+            phase = DCPU16N_PHASE_MARKSKIP;
+            break;
+        }
+        csc = DCPU16N_cycletable[64 + ((opcl >> 10) & 0x001f)];
+    }
+
+
+    if(csc) {
+        phasenext   = phase;
+        phase       = DCPU16N_PHASE_EXECW;
+        wait_cycles = csc - 1;
+        return true;
+    }
+    return false;
+}
+
+inline void DCPU16N::WriteOperand()
+{
+    if(wrt & 0x0100) {
+        phase = DCPU16N_PHASE_OPFETCH;
+        if(wrt & 0x0020) {
+            // nothing
+        }
+        else {
+            if(wrt & 0x010) {
+                if(wrt & 0x08) {
+                    switch(wrt & 0x7) {
+                    case 0: // PUSH [--SP]
+                        addrdec = true;
+                        break;
+
+                    case 1: // [SP]
+                        addrdec = true;
+                        break;
+
+                    case 2: // [SP + nextword]
+                        addrdec = true;
+                        break;
+
+                    case 3: // SP
+                        if(bytemode) {
+                            if(bytehigh)
+                                sp = (bcu & 0x00ff) | (sp & 0xff00);
+                            else
+                                sp = (bcu & 0xff00) | (sp & 0x00ff);
+                        } else {
+                            sp = bcu;
+                        }
+                        break;
+
+                    case 4: // PC
+                        if(bytemode) {
+                            if(bytehigh)
+                                pc = (bcu & 0x00ff) | (pc & 0xff00);
+                            else
+                                pc = (bcu & 0xff00) | (pc & 0x00ff);
+                        }
+                        else {
+                            pc = bcu;
+                        }
+                        break;
+
+                    case 5: // EX
+                        if(bytemode) {
+                            if(bytehigh)
+                                ex = (bcu & 0x00ff) | (ex & 0xff00);
+                            else
+                                ex = (bcu & 0xff00) | (ex & 0x00ff);
+                        }
+                        else {
+                            ex = bcu;
+                        }
+                        break;
+
+                    case 6: // [nextword]
+                        addrdec = true;
+                        break;
+
+                    case 7:
+                        break;
+                    } // switch
+                }
+                else {
+                    // [REG + nextword]
+                    addrdec = true;
+                }
+            }
+            else {
+                if(wrt & 0x08) {
+                    // [REG]
+                    addrdec = true;
+                }
+                else {
+                    // REG
+                    if(bytemode) {
+                        if(bytehigh)
+                            r[wrt & 0x7] = (r[wrt & 0x7] & 0xff00)
+                                           | (bcu & 0x00ff);
+                        else
+                            r[wrt & 0x7] = (r[wrt & 0x7] & 0x00ff)
+                                           | (bcu & 0xff00);
+                    }
+                    else {
+                        r[wrt & 0x7] = bcu;
+                    }
+                }
+            }
+        }
+    }
+}
+
+inline void DCPU16N::WriteOperandMemory()
+{
+    if(addrdec) {
+        addrdec = false;
+        if(!bytemode) {
+            WriteWord(bca_bank, bca, bcu);
+        }
+        else if(bytehigh) {
+            vcomp->WriteB(bca, (Byte)(bcu & 0x0ff));
+        }
+        else {
+            vcomp->WriteB(bca + 1, (Byte)(bcu >> 8));
+        }
+    }
+    if(wrt & 0x0100)
+        bytemode = false;
+}
+
+void DCPU16N::SkipOpCode()
+{
+    if( (opcl & 0x001f) != 0 ) {
+        skip = DCPU16N_skipstateN[ opcl & 0x001f];
+        pc  += DCPU16N_skipadd[ (opcl >> 10) & 0x3f ];
+        pc  += DCPU16N_skipadd[ (opcl >>  5) & 0x1f ];
+    }
+    else if((opcl & 0x03e0) != 0) {
+        skip = false;
+        pc  += DCPU16N_skipadd[ (opcl >> 10) & 0x3f ];
+    }
+    else {
+        skip = DCPU16N_skipstateI[ (opcl >> 10) & 0x001f ];
+    }
+    phase = DCPU16N_PHASE_OPFETCH;
+}
+
+void DCPU16N::PushJump()
+{
+    sp -= 2;
+    bca = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
+    WriteWord((sp >> 12) & 0xf, bca, bcu);
+    pc = acu;
+    phase = DCPU16N_PHASE_OPFETCH;
+}
+
+void DCPU16N::ReturnFromInterrupt()
+{
+    phase = DCPU16N_PHASE_OPFETCH;
+    qint  = false;
+
+    // pop A
+    bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
+    r[0]  = ReadWord((sp >> 12) & 0xf, bca);
+    sp   += 2;
+
+    // pop PC
+    bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
+    pc    = ReadWord((sp >> 12) & 0xf, bca);
+    sp   += 2;
+}
+
+void DCPU16N::EnterInterrupt()
+{
+    phase = DCPU16N_PHASE_OPFETCH;
+    qint  = true; // Queue interrupts
+
+    // push PC
+    sp   -= 2;
+    bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
+    WriteWord((sp >> 12) & 0xf, bca, pc);
+
+    // push A
+    sp -= 2;
+    bca = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
+    WriteWord((sp >> 12) & 0xf, bca, r[0]);
+
+    // set interrupt address and message
+    pc = ia;
+    r[0] = intq[iqe]; // remove one from queue
+    iqe++;
+    iqc--;
+    if(iqe > 255)
+        iqe = 0;
+}
+
+inline Word DCPU16N::NextWord()
+{
+    const DWord cfa  = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
+    const Word  word = ReadWord((pc >> 12) & 0xf, cfa, true);
+    pc += 2;
+    return word;
+}
+
+inline Word DCPU16N::ReadOperand(Byte mode, Word val, DWord& addr, unsigned& bank)
+{
+    Word u;
+    switch(mode) {
+    case OPD_REG:
+        return r[val];
+
+    case OPD_LITERAL:
+        return val;
+
+    case OPD_SP:
+        return sp;
+
+    case OPD_PC:
+        return pc;
+
+    case OPD_EX:
+        return ex;
+
+    case OPD_NW:
+        fetchh = NextWord();
+        return fetchh;
+
+    case OPD_REG_MEM:
+        u = r[val];
+        break;
+
+    case OPD_REG_NW:
+        fetchh = NextWord() + r[val];
+        u      = fetchh;
+        break;
+
+    case OPD_POP:
+        u   = sp;
+        sp += 2;
+        break;
+
+    case OPD_PUSH:
+        sp -= 2;
+        u   = sp;
+        break;
+
+    case OPD_PEEK:
+        u = sp;
+        break;
+
+    case OPD_PICK:
+        fetchh = NextWord() + sp;
+        u      = fetchh;
+        break;
+
+    default: // OPD_NW_MEM
+        fetchh = NextWord();
+        u      = fetchh;
+        break;
+    }
+
+    bank = (u >> 12) & 0xf;
+    addr = emu[bank] | (u & 0x0fff);
+    return ReadWord(bank, addr);
+}
+
+const DCPU16N::DecodedInst& DCPU16N::Decode(unsigned bank, DWord addr)
+{
+    // Mode of the operands that are on the SP/PC/EX/nextword row
+    static const Byte rowmode_a[8] = {
+        OPD_POP, OPD_PEEK, OPD_PICK, OPD_SP, OPD_PC, OPD_EX, OPD_NW_MEM, OPD_NW,
+    };
+    static const Byte rowmode_b[8] = {
+        OPD_PUSH, OPD_PEEK, OPD_PICK, OPD_SP, OPD_PC, OPD_EX, OPD_NW_MEM, OPD_NW,
+    };
+
+    DecodedInst d;
+    d.addr  = addr;
+    d.opcl  = ReadWord(bank, addr, true);
+    d.a     = 0;
+    d.b     = 0;
+    d.amode = OPD_NONE;
+    d.bmode = OPD_NONE;
+
+    const Word opca = d.opcl >> 10;
+    const Word opcb = (d.opcl >> 5) & 0x01f;
+    unsigned csc;
+    if((d.opcl & 0x001f) != 0) {
+        d.fetch = DCPU16N_acycles[opca] + DCPU16N_bcycles[opcb];
+        csc     = DCPU16N_cycletable[d.opcl & 0x001f];
+        if((opcb & 0x18) == 0x18) {
+            d.bmode = rowmode_b[opcb & 0x7];
+        }
+        else {
+            d.b     = opcb & 0x7;
+            d.bmode = OPD_REG;
+            if(opcb & 0x10) {
+                d.bmode = OPD_REG_NW;
+            }
+            else if(opcb & 0x08) {
+                d.bmode = OPD_REG_MEM;
+            }
+        }
+    }
+    else if(opcb != 0) {
+        d.fetch = DCPU16N_acycles[opca];
+        csc     = DCPU16N_cycletable[32 + opcb];
+    }
+    else {
+        d.fetch = 0;
+        csc     = DCPU16N_cycletable[64 + (opca & 0x001f)];
+    }
+    d.wait = csc > 2 ? csc - 1 : (csc > 0 ? 1 : 0);
+
+    if((d.opcl & 0x03ff) != 0) {
+        if(opca & 0x0020) {
+            d.a     = (Word)(0xffffu + (opca & 0x1f));
+            d.amode = OPD_LITERAL;
+        }
+        else if((opca & 0x18) == 0x18) {
+            d.amode = rowmode_a[opca & 0x7];
+        }
+        else {
+            // Like on UAREAD, [REG + nextword] reads only REG
+            d.a     = opca & 0x7;
+            d.amode = OPD_REG;
+            if((opca & 0x18) == 0x08) {
+                d.amode = OPD_REG_MEM;
+            }
+        }
+    }
+
+    // Only code from RAM or ROM could be cached. The VComputer will tell us
+    // if somebody writes over it
+    if(vcomp->WatchCode(addr, 2)) {
+        if(vcomp->BusVersion() != banks_version) {
+            MapBanks(); // Writes to the page must go by the bus now
+        }
+        DecodedInst& entry = icache[(addr >> 1) & (ICACHE_SIZE - 1)];
+        if(entry.addr != ICACHE_INVALID) {
+            CountCode(entry, -1); // Evicted
+        }
+        entry = d;
+        CountCode(entry, 1);
+        return entry;
+    }
+    uncached = d;
+    return uncached;
+} // Decode
+
+void DCPU16N::CountCode(const DecodedInst& entry, int inc)
+{
+    const DWord last = (entry.addr + 1) >> BusPageShift;
+    for(DWord page = entry.addr >> BusPageShift; page <= last; page++) {
+        icache_pages[page] += inc;
+    }
+} // CountCode
+
+void DCPU16N::InvalidateCode(DWord addr, std::size_t size)
+{
+    // An opcode could begin a byte before the address
+    const DWord first = (addr >= 1) ? addr - 1 : 0;
+    if(size >= ICACHE_SIZE * 2) {
+        for(auto& entry : icache) {
+            entry.addr = ICACHE_INVALID;
+        }
+        std::fill(icache_pages.begin(), icache_pages.end(), 0);
+    }
+    else {
+        for(DWord a = first; a < addr + size; a++) {
+            DecodedInst& entry = icache[(a >> 1) & (ICACHE_SIZE - 1)];
+            if(entry.addr == a) {
+                CountCode(entry, -1);
+                entry.addr = ICACHE_INVALID;
+            }
+        }
+    }
+
+    // Written pages without cached opcodes are not trapped anymore
+    const DWord last = (std::min<std::size_t>(addr + size, 0x1000000) - 1) >> BusPageShift;
+    for(DWord page = first >> BusPageShift; page <= last; page++) {
+        if(icache_pages[page] == 0) {
+            vcomp->UnwatchCode(page << BusPageShift, BusPageSize);
+        }
+    }
+} // InvalidateCode
+
+unsigned DCPU16N::ExecInstruction(unsigned n)
+{
+    // Interrupts take a cycle to be seen, and other to push PC and A
+    if(iqc > 0 && !qint && !(skip || bytemode)) {
+        if(ia == 0) {
+            iqc = 0;
+        }
+        else if(n < 2) {
+            return 0;
+        }
+        else {
+            EnterInterrupt();
+            pwrdraw += 10;
+            return 2;
+        }
+    }
+
+    const unsigned bank = (pc >> 12) & 0xf;
+    const DWord    cfa  = emu[bank] | (pc & 0x0fff);
+    const DecodedInst* dec = &icache[(cfa >> 1) & (ICACHE_SIZE - 1)];
+    if(dec->addr != cfa) {
+        // Setting a breakpoint invalidates the cached opcode
+        if(vcomp->isBreakPoint(cfa)) {
+            return 0; // A debugger could look at each phase
+        }
+        dec = &Decode(bank, cfa);
+    }
+    opcl = dec->opcl;
+    pc  += 2;
+
+    if(skip) {
+        if(n < 2) {
+            phase    = DCPU16N_PHASE_EXECSKIP;
+            pwrdraw += 5;
+            return 1;
+        }
+        SkipOpCode();
+        pwrdraw += 10;
+        return 2;
+    }
 
-    for(i = 0; i < 16; i++) {
-        emu[i] = i << 12;
+    // Cycles used by the phased engine : opcode fetch, next words and
+    // operand reads, cycles of EXECW, and at worst, an extra cycle to write
+    // the result, jump or mark the skip
+    const unsigned fetch = dec->fetch;
+    const unsigned wait  = dec->wait;
+    if(1 + fetch + wait + 1 > n) {
+        // Ends on other Tick call. The phased engine does the rest of the
+        // cycle, like after OPFETCH
+        phase = DCPU16N_PHASE_UAREAD;
+        return 0;
     }
 
-    iqp = 0;
-    iqe = 0;
-    iqc = 0;
+    if(dec->amode != OPD_NONE) {
+        acu = ReadOperand(dec->amode, dec->a, aca, aca_bank);
+    }
+    if(dec->bmode != OPD_NONE) {
+        bcu = ReadOperand(dec->bmode, dec->b, bca, bca_bank);
+    }
+    pwrdraw += 5 * fetch; // HCF reads it
+    unsigned steps = 1;   // Nº of phases, each one draws power
+    unsigned used  = 1 + fetch;
+    if(ExecOpCode()) {
+        // EXECW, with enough cycles to wait all at once
+        if(wait_cycles > 0) {
+            wait_cycles--;
+        }
+        phase = phasenext;
+        steps++;
+        used += wait;
+    }
+    else {
+        WriteOperand();
+        WriteOperandMemory();
+    }
 
-    pwrdraw = 0;
-    phase   = 0;
+    switch(phase) {
+    case DCPU16N_PHASE_UBWRITE:
+        WriteOperand();
+        WriteOperandMemory();
+        break;
 
-    wait_cycles = 0;
-    last_cycles = 0;
+    case DCPU16N_PHASE_MARKSKIP:
+        skip  = true;
+        phase = DCPU16N_PHASE_OPFETCH;
+        break;
 
-    acu    = 0;
-    aca    = 0;
-    bcu    = 0;
-    bca    = 0;
-    opcl   = 0;
-    wrt    = 0;
-    fetchh = 0;
+    case DCPU16N_PHASE_EXECJMP:
+        PushJump();
+        break;
 
-    addradd  = false;
-    addrdec  = false;
-    bytemode = false;
-    bytehigh = false;
-    skip     = false;
-    fire     = false;
-    qint     = false;
-    // point EMU at ROM (page 0x100)
-    emu[0] = 0x00100000;
+    case DCPU16N_PHASE_EXECRFI:
+        ReturnFromInterrupt();
+        break;
 
-} // Reset
+    default: // OPFETCH or SLEEP
+        pwrdraw += 5 * steps;
+        return used;
+    }
+    pwrdraw += 5 * (steps + 1);
+    return used + 1;
+}
 
-unsigned DCPU16N::Step()
+unsigned DCPU16N::FastTick(unsigned n)
 {
-    unsigned x = 0;
-    do {
-        Tick(1);
-        x++;
-    } while( (!fire) && (phase != 0) && (phase != DCPU16N_PHASE_SLEEP) );
-    last_cycles = x;
-    return x;
+    unsigned left = n;
+    while(left > 0) {
+        if(phase == DCPU16N_PHASE_OPFETCH) {
+            const unsigned used = ExecInstruction(left);
+            if(used > 0) {
+                left -= used;
+                continue;
+            }
+        }
+        // Ends the actual instruction (or the sleep) phase by phase
+        left -= RealTick(left, true);
+    }
+    return n;
 }
 
-void DCPU16N::Tick(unsigned n)
+unsigned DCPU16N::RealTick(unsigned n, bool until_fetch)
 {
+    const unsigned cycles = n;
     DWord cfa;
-    register int32_t s32;
     Word opca;
-    register unsigned csc;
 
     while(n--) {
         switch(phase) {
         case DCPU16N_PHASE_NWAFETCH:
             cfa    = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
-            fetchh = ( ((Word)vcomp->ReadB(cfa + 1)) << 8 )
-                     |  (Word)vcomp->ReadB(cfa);
+            fetchh = ReadWord((pc >> 12) & 0xf, cfa, true);
             pc    += 2;
             if(addradd) {
                 fetchh += acu;
@@ -146,8 +1140,7 @@ void DCPU16N::Tick(unsigned n)
 
         case DCPU16N_PHASE_NWBFETCH:
             cfa    = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
-            fetchh = ( ((Word)vcomp->ReadB(cfa + 1)) << 8 )
-                     |  (Word)vcomp->ReadB(cfa);
+            fetchh = ReadWord((pc >> 12) & 0xf, cfa, true);
             pc    += 2;
             if(addradd) {
                 fetchh += bcu;
@@ -174,8 +1167,7 @@ void DCPU16N::Tick(unsigned n)
                 }
             }
             cfa  = emu[(pc >> 12) & 0xf] | (pc & 0x0fff);
-            opcl = ( ((Word)vcomp->ReadB(cfa + 1)) << 8 )
-                   |  (Word)vcomp->ReadB(cfa);
+            opcl = ReadWord((pc >> 12) & 0xf, cfa, true);
             pc  += 2;
             if(skip) {
                 phase = DCPU16N_PHASE_EXECSKIP;
@@ -265,9 +1257,9 @@ void DCPU16N::Tick(unsigned n)
         case DCPU16N_PHASE_ACUFETCH:
             if(addrdec) {
                 addrdec = false;
-                aca     = emu[(acu >> 12) & 0xf] | (acu & 0x0fff);
-                acu     = ( ((Word)vcomp->ReadB(aca + 1)) << 8)
-                          |  (Word)vcomp->ReadB(aca);
+                aca_bank = (acu >> 12) & 0xf;
+                aca      = emu[aca_bank] | (acu & 0x0fff);
+                acu      = ReadWord(aca_bank, aca);
             }
 
         case DCPU16N_PHASE_UBREAD:
@@ -345,509 +1337,21 @@ void DCPU16N::Tick(unsigned n)
         case DCPU16N_PHASE_BCUFETCH:
             if(addrdec) {
                 addrdec = false;
-                bca     = emu[(bcu >> 12) & 0xf] | (bcu & 0x0fff);
-                bcu     = ( ((Word)vcomp->ReadB(bca + 1)) << 8 )
-                          |  (Word)vcomp->ReadB(bca);
+                bca_bank = (bcu >> 12) & 0xf;
+                bca      = emu[bca_bank] | (bcu & 0x0fff);
+                bcu      = ReadWord(bca_bank, bca);
             }
 
         case DCPU16N_PHASE_EXEC:
-            phase = DCPU16N_PHASE_OPFETCH;
-            if( (opcl & 0x001f) != 0 ) {
-                wrt = (opcl >> 5) & 0x1f;
-                switch(opcl & 0x001f) {
-                case 0x01: // SET (wb ra)
-                    bcu = acu;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x02: // ADD (rwb ra)
-                    cfa  = bcu;
-                    cfa += acu;
-                    bcu  = (Word)cfa;
-                    ex   = (Word)(cfa >> 16);
-                    wrt |= 0x100;
-                    break;
-
-                case 0x03: // SUB (rwb ra)
-                    s32  = (int16_t)bcu;
-                    s32 -= (int16_t)acu;
-                    bcu  = (Word)s32;
-                    ex   = (Word)(s32 >> 16);
-                    wrt |= 0x100;
-                    break;
-
-                case 0x04: // MUL (rwb ra)
-                    cfa  = bcu;
-                    cfa *= acu;
-                    bcu  = (Word)cfa;
-                    ex   = (Word)(cfa >> 16);
-                    wrt |= 0x100;
-                    break;
-
-                case 0x05: // MLI (rwb ra)
-                    s32  = (int16_t)bcu;
-                    s32 *= (int16_t)acu;
-                    bcu  = (Word)s32;
-                    ex   = (Word)(s32 >> 16);
-                    wrt |= 0x100;
-                    break;
-
-                case 0x06: // DIV (rwb ra)
-                    if(acu) {
-                        cfa = ( ( (DWord)bcu ) << 16 ) / acu;
-                        ex  = (Word)cfa;
-                        bcu = (Word)(cfa >> 16);
-                    }
-                    else {
-                        bcu = 0;
-                        ex  = 0;
-                    }
-                    wrt |= 0x100;
-                    break;
-
-                case 0x07: // DVI (rwb ra)
-                    if(acu) {
-                        if( ( (int16_t)bcu) % ( (int16_t)acu ) ) {
-                            ex = ( ( (int32_t)bcu ) << 16 ) / ( (int16_t)acu );
-                        }
-                        else {
-                            ex = 0;
-                        }
-                        bcu = (Word)( ( (int16_t)bcu ) / ( (int16_t)acu ) );
-                    }
-                    else {
-                        bcu = 0;
-                        ex  = 0;
-                    }
-                    wrt |= 0x100;
-                    break;
-
-                case 0x08: // MOD (rwb ra)
-                    if(acu) {
-                        bcu %= acu;
-                    }
-                    else {
-                        bcu = 0;
-                    }
-                    wrt |= 0x100;
-                    break;
-
-                case 0x09: // MDI (rwb ra)
-                    if(acu) {
-                        bcu = (Word)( ( (int16_t)bcu ) % ( (int16_t)acu ) );
-                    }
-                    else {
-                        bcu = 0;
-                    }
-                    wrt |= 0x100;
-                    break;
-
-                case 0x0a: // AND (rwb ra)
-                    bcu &= acu;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x0b: // BOR (rwb ra)
-                    bcu |= acu;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x0c: // XOR (rwb ra)
-                    bcu ^= acu;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x0d: // SHR (rwb ra)
-                    cfa   = bcu << 16;
-                    cfa >>= acu;
-                    ex    = (Word)cfa;
-                    bcu   = (Word)(cfa >> 16);
-                    wrt  |= 0x100;
-                    break;
-
-                case 0x0e: // ASR (rwb ra)
-                    s32  = (int16_t)bcu;
-                    ex   = (Word)( bcu << (16 - acu) );
-                    bcu  = (Word)(s32 >> acu);
-                    wrt |= 0x100;
-                    break;
-
-                case 0x0f: // SHL (rwb ra)
-                    cfa   = bcu;
-                    cfa <<= acu;
-                    ex    = (Word)(cfa >> 16);
-                    bcu   = (Word)cfa;
-                    wrt  |= 0x100;
-                    break;
-
-                case 0x10: // IFB (rb ra)
-                    if( (acu & bcu) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x11: // IFC (rb ra)
-                    if( !(acu & bcu) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x12: // IFE (rb ra)
-                    if( !(acu == bcu) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x13: // IFN (rb ra)
-                    if( !(acu != bcu) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x14: // IFG (rb ra)
-                    if( !(bcu > acu) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x15: // IFA (rb ra)
-                    if( !( ( (int16_t)bcu ) > ( (int16_t)acu ) ) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x16: // IFL (rb ra)
-                    if(!(bcu < acu)) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                case 0x17: // IFU (rb ra)
-                    if( !( ( (int16_t)bcu ) < ( (int16_t)acu ) ) ) {
-                        phase = DCPU16N_PHASE_MARKSKIP;
-                    }
-                    break;
-
-                //case 0x18:
-                //  break;
-                //case 0x19:
-                //  break;
-
-                case 0x1a: // ADX (rwb ra)
-                    cfa  = bcu;
-                    cfa += acu + ex;
-                    ex   = (Word)(cfa >> 16);
-                    bcu  = (Word)cfa;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x1b: // SBX (rwb ra)
-                    cfa  = bcu;
-                    cfa  = cfa - acu + ex;
-                    ex   = (Word)(cfa >> 16);
-                    bcu  = (Word)cfa;
-                    wrt |= 0x100;
-                    break;
-
-                case 0x1c: // HWW (rb ra)
-                    IOWrite(bcu, acu);
-                    break;
-
-                case 0x1d: // HWR (rb wa)
-                    bcu = IORead(bcu);
-                    wrt = (opcl >> 10) | 0x100;
-                    break;
-
-                case 0x1e: // STI (wb ra)
-                    bcu   = acu;
-                    r[6] += 2;
-                    r[7] += 2;
-                    wrt  |= 0x100;
-                    break;
-
-                case 0x1f: // STD (wb ra)
-                    bcu   = acu;
-                    r[6] -= 2;
-                    r[7] -= 2;
-                    wrt  |= 0x100;
-                    break;
-                }
-                if(wrt & 0x0100)
-                    phase = DCPU16N_PHASE_UBWRITE;
-                csc = DCPU16N_cycletable[opcl & 0x001f];
-                if(csc) {
-                    //if(csc == 1) break;
-                    phasenext   = phase;
-                    phase       = DCPU16N_PHASE_EXECW;
-                    wait_cycles = csc - 1;
-                    break;
-                }
-            }
-            else if((opcl & 0x03e0) != 0) {
-                wrt = (opcl >> 10);
-                bca = aca;
-                switch((opcl >> 5) & 0x001f) {
-                case 0x01: // JSR (ra)
-                    bcu   = pc;
-                    phase = DCPU16N_PHASE_EXECJMP;
-                    break;
-
-                case 0x02: // BSR (ra)
-                    bcu   = pc;
-                    phase = DCPU16N_PHASE_EXECJMP;
-                    acu  += pc;
-                    break;
-
-                //case 0x03:
-                //  break;
-                //case 0x04:
-                //  break;
-
-                case 0x05: // NEG (rwa)
-                    wrt  |= 0x0100;
-                    phase = DCPU16N_PHASE_UBWRITE;
-                    bcu   = (Word)(-((int16_t)acu));
-                    break;
-
-                //case 0x06:
-                //  break;
-
-                case 0x07: // HCF (^w^OMGFTWBBQa)
-                    bcu  = (Word)pwrdraw;
-                    fire = true;
-                    break;
-
-                case 0x08: // INT (ra)
-                    SendInterrupt(acu);
-                    break;
-
-                case 0x09: // IAG (wa)
-                    wrt  |= 0x0100;
-                    phase = DCPU16N_PHASE_UBWRITE;
-                    bcu   = ia;
-                    break;
-
-                case 0x0a: // IAS (ra)
-                    ia = acu;
-                    break;
-
-                case 0x0b: // RFI (ra)
-                    phase = DCPU16N_PHASE_EXECRFI;
-                    break;
-
-                case 0x0c: // IAQ (ra)
-                    qint = acu ? true : false;
-                    break;
-
-                //case 0x0d:
-                //  break;
-                //case 0x0e:
-                //  break;
-                //case 0x0f:
-                //  break;
-
-                case 0x10: // MMW (ra)
-                    emu[acu & 0x0f] = ((DWord)acu & 0xfff0) << 8;
-                    break;
-
-                case 0x11: // MMR (rwa)
-                    wrt  |= 0x0100;
-                    phase = DCPU16N_PHASE_UBWRITE;
-                    bcu   = (emu[acu & 0x0f] >> 8) | (acu & 0x0f);
-                    break;
-
-                //case 0x12:
-                //  break;
-                //case 0x13:
-                //  break;
-
-                case 0x14: // SXB (rwa)
-                    wrt  |= 0x0100;
-                    phase = DCPU16N_PHASE_UBWRITE;
-                    bcu   = (-(acu & 0x80)) | (acu & 0x00ff);
-                    break;
-
-                case 0x15: // SWP (rwa)
-                    wrt  |= 0x0100;
-                    phase = DCPU16N_PHASE_UBWRITE;
-                    bcu   = ((acu >> 8) & 0xff) | ((acu << 8) & 0xFF00);
-                    break;
-
-                //case 0x16:
-                //  break;
-                //case 0x17:
-                //  break;
-                //case 0x18:
-                //  break;
-                //case 0x19:
-                //  break;
-                //case 0x1a:
-                //  break;
-                //case 0x1b:
-                //  break;
-                //case 0x1c:
-                //  break;
-                //case 0x1d:
-                //  break;
-                //case 0x1e:
-                //  break;
-                //case 0x1f:
-                //  break;
-                } // switch
-                csc = DCPU16N_cycletable[32 + ( (opcl >> 5) & 0x001f )];
-                if(csc) {
-                    //if(csc == 1) break;
-                    phasenext   = phase;
-                    phase       = DCPU16N_PHASE_EXECW;
-                    wait_cycles = csc - 1;
-                    break;
-                }
-            }
-            else {
-                wrt = 0x003f;
-                switch((opcl >> 10) & 0x001f) {
-                case 0x00: // HLT
-                    bytemode = false;
-                    if(ia && !qint) {
-                        SendInterrupt(0);
-                    }
-                    phase = DCPU16N_PHASE_SLEEP;
-                    break;
-
-                case 0x01: // SLP
-                    bytemode = false;
-                    phase    = DCPU16N_PHASE_SLEEP;
-                    break;
-
-                //case 0x02:
-                //  break;
-                //case 0x03:
-                //  break;
-
-                case 0x04: // BYT (rv)
-                    bytemode = !bytemode;
-                    bytehigh = opcl & 0x8000 ? true : false;
-                    break;
-
-                case 0x10: // SKP
-                    phase = DCPU16N_PHASE_MARKSKIP;
-                    break;
-                }
-                csc = DCPU16N_cycletable[64 + ((opcl >> 10) & 0x001f)];
-                if(csc) {
-                    //if(csc == 1) break;
-                    phasenext   = phase;
-                    phase       = DCPU16N_PHASE_EXECW;
-                    wait_cycles = csc - 1;
-                    break;
-                }
+            if(ExecOpCode()) {
+                break; // Waits the cycles of the instruction
             }
 
         case DCPU16N_PHASE_UBWRITE:
-            if(wrt & 0x0100) {
-                phase = DCPU16N_PHASE_OPFETCH;
-                if(wrt & 0x0020) {
-                    // nothing
-                }
-                else {
-                    if(wrt & 0x010) {
-                        if(wrt & 0x08) {
-                            switch(wrt & 0x7) {
-                            case 0: // PUSH [--SP]
-                                addrdec = true;
-                                break;
-
-                            case 1: // [SP]
-                                addrdec = true;
-                                break;
-
-                            case 2: // [SP + nextword]
-                                addrdec = true;
-                                break;
-
-                            case 3: // SP
-                                if(bytemode) {
-                                    if(bytehigh)
-                                        sp = (bcu & 0x00ff) | (sp & 0xff00);
-                                    else
-                                        sp = (bcu & 0xff00) | (sp & 0x00ff);
-                                } else {
-                                    sp = bcu;
-                                }
-                                break;
-
-                            case 4: // PC
-                                if(bytemode) {
-                                    if(bytehigh)
-                                        pc = (bcu & 0x00ff) | (pc & 0xff00);
-                                    else
-                                        pc = (bcu & 0xff00) | (pc & 0x00ff);
-                                }
-                                else {
-                                    pc = bcu;
-                                }
-                                break;
-
-                            case 5: // EX
-                                if(bytemode) {
-                                    if(bytehigh)
-                                        ex = (bcu & 0x00ff) | (ex & 0xff00);
-                                    else
-                                        ex = (bcu & 0xff00) | (ex & 0x00ff);
-                                }
-                                else {
-                                    ex = bcu;
-                                }
-                                break;
-
-                            case 6: // [nextword]
-                                addrdec = true;
-                                break;
-
-                            case 7:
-                                break;
-                            } // switch
-                        }
-                        else {
-                            // [REG + nextword]
-                            addrdec = true;
-                        }
-                    }
-                    else {
-                        if(wrt & 0x08) {
-                            // [REG]
-                            addrdec = true;
-                        }
-                        else {
-                            // REG
-                            if(bytemode) {
-                                if(bytehigh)
-                                    r[wrt & 0x7] = (r[wrt & 0x7] & 0xff00)
-                                                   | (bcu & 0x00ff);
-                                else
-                                    r[wrt & 0x7] = (r[wrt & 0x7] & 0x00ff)
-                                                   | (bcu & 0xff00);
-                            }
-                            else {
-                                r[wrt & 0x7] = bcu;
-                            }
-                        }
-                    }
-                }
-            }
+            WriteOperand();
 
         case DCPU16N_PHASE_BCUWRITE:
-            if(addrdec) {
-                addrdec = false;
-                if(bytehigh || !bytemode) {
-                    vcomp->WriteB(bca, (Byte)(bcu & 0x0ff));
-                }
-                if(!bytehigh || !bytemode) {
-                    vcomp->WriteB(bca + 1, (Byte)(bcu >> 8));
-                }
-            }
-            if(wrt & 0x0100)
-                bytemode = false;
+            WriteOperandMemory();
             break;
 
         case DCPU16N_PHASE_EXECW:
@@ -882,45 +1386,15 @@ void DCPU16N::Tick(unsigned n)
             break;
 
         case DCPU16N_PHASE_EXECSKIP:
-            if( (opcl & 0x001f) != 0 ) {
-                skip = DCPU16N_skipstateN[ opcl & 0x001f];
-                pc  += DCPU16N_skipadd[ (opcl >> 10) & 0x3f ];
-                pc  += DCPU16N_skipadd[ (opcl >>  5) & 0x1f ];
-            }
-            else if((opcl & 0x03e0) != 0) {
-                skip = false;
-                pc  += DCPU16N_skipadd[ (opcl >> 10) & 0x3f ];
-            }
-            else {
-                skip = DCPU16N_skipstateI[ (opcl >> 10) & 0x001f ];
-            }
-            phase = DCPU16N_PHASE_OPFETCH;
+            SkipOpCode();
             break;
 
         case DCPU16N_PHASE_EXECJMP:
-            sp -= 2;
-            bca = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
-            vcomp->WriteB(bca, (Byte)(bcu & 0x0ff));
-            vcomp->WriteB(bca + 1, (Byte)(bcu >> 8));
-            pc = acu;
-            phase = DCPU16N_PHASE_OPFETCH;
+            PushJump();
             break;
 
         case DCPU16N_PHASE_EXECRFI:
-            phase = DCPU16N_PHASE_OPFETCH;
-            qint  = false;
-
-            // pop A
-            bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
-            sp   += 2;
-            r[0]  = ( ( (Word)vcomp->ReadB(bca + 1) ) << 8 )
-                      | (Word)vcomp->ReadB(bca);
-
-            // pop PC
-            bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
-            sp   += 2;
-            pc    = ( ( (Word)vcomp->ReadB(bca + 1) ) << 8 )
-                      | (Word)vcomp->ReadB(bca);
+            ReturnFromInterrupt();
             break;
 
         case DCPU16N_PHASE_MARKSKIP:
@@ -929,28 +1403,7 @@ void DCPU16N::Tick(unsigned n)
             break;
 
         case DCPU16N_PHASE_INTERRUPT:
-            phase = DCPU16N_PHASE_OPFETCH;
-            qint  = true; // Queue interrupts
-
-            // push PC
-            sp   -= 2;
-            bca   = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
-            vcomp->WriteB(bca, (Byte)(pc & 0x0ff));
-            vcomp->WriteB(bca + 1, (Byte)(pc >> 8));
-
-            // push A
-            sp -= 2;
-            bca = emu[(sp >> 12) & 0xf] | (sp & 0x0fff);
-            vcomp->WriteB(bca, (Byte)(r[0] & 0x0ff));
-            vcomp->WriteB(bca + 1, (Byte)(r[0] >> 8));
-
-            // set interrupt address and message
-            pc = ia;
-            r[0] = intq[iqe]; // remove one from queue
-            iqe++;
-            iqc--;
-            if(iqe > 255)
-                iqe = 0;
+            EnterInterrupt();
             break;
 
         default:
@@ -958,7 +1411,11 @@ void DCPU16N::Tick(unsigned n)
             break;
         }
         pwrdraw += 5;
+        if(until_fetch && phase == DCPU16N_PHASE_OPFETCH) {
+            return cycles - n;
+        }
     }
+    return cycles;
 }
 
 bool DCPU16N::SendInterrupt(Word msg)
@@ -980,18 +1437,26 @@ bool DCPU16N::SendInterrupt(Word msg)
 
 Word DCPU16N::IORead(Word addr)
 {
-    return vcomp->ReadW(0x00110000 | addr);
+    return vcomp->ReadPort(addr);
 }
 
 void DCPU16N::IOWrite(Word addr, Word v)
 {
-    vcomp->WriteW(0x00110000 | addr, v);
+    vcomp->WritePort(addr, v);
+    if(vcomp->BusVersion() != banks_version) {
+        MapBanks(); // The device has changed the bus map
+    }
 }
 
 bool DCPU16N::DoesTrap(Word& msg) {
 	return false;
 }
 
+bool DCPU16N::isSleeping() const
+{
+    return phase == DCPU16N_PHASE_SLEEP;
+}
+
 void DCPU16N::GetState(void* ptr, std::size_t& size) const
 {
     if(ptr != nullptr && size >= sizeof(DCPU16NState)) {
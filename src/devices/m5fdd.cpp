@@ -11,6 +11,7 @@
 #include "vs_fix.hpp"
 
 #include <cstdio>
+#include <algorithm>
 
 namespace trillek {
 namespace computer {
@@ -208,31 +209,37 @@ void M5FDD::IACK() {
 }
 
 void M5FDD::Tick(unsigned n, const double delta) {
-    for (unsigned i = 0; i < n; i++) {
-        if (busyCycles > 0 && state == STATE_CODES::BUSY) {
-
-            //TODO: integrate with DMA system
-            busyCycles--;
+    while (n > 0 && state == STATE_CODES::BUSY) {
+        if (busyCycles > 0) {
+            // Moves a byte per device cycle, but we do it in a single chunk
+            const unsigned cycles = std::min(n, busyCycles);
+            busyCycles -= cycles;
+            n          -= cycles;
 
             // continue DMAing RAM <-> BUFFER
-            if (curPosition < floppy->getDescriptor()->BytesPerSector) {
+            const unsigned bytesPerSector = floppy->getDescriptor()->BytesPerSector;
+            if (curPosition < bytesPerSector) {
+                const unsigned len = std::min(cycles, bytesPerSector - curPosition);
                 if (writing) { // Writing to disk
-                    sectorBuffer[curPosition] = vcomp->ReadB(dmaLocation + curPosition);
+                    vcomp->DmaRead(dmaLocation + curPosition, &sectorBuffer[curPosition], len);
                 } else { // Reading from disk
-                    vcomp->WriteB(dmaLocation + curPosition, sectorBuffer[curPosition]);
+                    vcomp->DmaWrite(dmaLocation + curPosition, &sectorBuffer[curPosition], len);
                 }
-                curPosition++;
-            }
+                curPosition += len;
 
-            // just finished DMAing to the buffer, write it
-            if (writing && curPosition == floppy->getDescriptor()->BytesPerSector) {
-                auto lba = CHStoLBA(curTrack, curHead, curSector, *(floppy->getDescriptor()));
-                floppy->writeSector(lba, &sectorBuffer);
+                // just finished DMAing to the buffer, write it
+                if (writing && curPosition == bytesPerSector) {
+                    auto lba = CHStoLBA(curTrack, curHead, curSector, *(floppy->getDescriptor()));
+                    floppy->writeSector(lba, &sectorBuffer);
+                }
             }
-        } else if (floppy && state == STATE_CODES::BUSY) {
+        } else if (floppy) {
             // Updates state
             state = floppy->isProtected() ? STATE_CODES::READY_WP : STATE_CODES::READY;
             pendingInterrupt = true; // State changes
+            n--;
+        } else {
+            break;
         }
     }
 } // Tick
@@ -38,8 +38,9 @@ void Timer::Tick (unsigned n, const double delta) {
         tmp   = tmr0;
         tmr0 -= n;
         if (tmr0 > tmp) {
-            // Underflow of TMR0
-            tmr0        = re0 - (0xFFFFFFFF - tmr0);
+            // Underflow of TMR0. A long tick could reload it more times
+            const DWord left = n - tmp - 1;
+            tmr0        = re0 - ((re0 != 0xFFFFFFFF) ? left % (re0 + 1) : left);
             do_int_tmr0 = (cfg & 2) != 0;
         }
     }
@@ -49,12 +50,25 @@ void Timer::Tick (unsigned n, const double delta) {
         tmr1 -= n;
         if (tmr1 > tmp) {
             // Underflow of TMR1
-            tmr1        = re1 - (0xFFFFFFFF - tmr1);
+            const DWord left = n - tmp - 1;
+            tmr1        = re1 - ((re1 != 0xFFFFFFFF) ? left % (re1 + 1) : left);
             do_int_tmr1 = (cfg & 16) != 0;
         }
     }
 } // Tick
 
+DWord Timer::NextEvent () const {
+    // A timer underflows after tmrX + 1 cycles
+    DWord next = 0xFFFFFFFF;
+    if ( (cfg & 0x03) == 0x03 && tmr0 < next ) {
+        next = tmr0 + 1;
+    }
+    if ( (cfg & 0x18) == 0x18 && tmr1 < next ) {
+        next = tmr1 + 1;
+    }
+    return next;
+} // NextEvent
+
 bool Timer::DoesInterrupt(Word& msg) {
     if ( ( (cfg & 2) != 0 ) && do_int_tmr0 ) {
         // TMR0 does an interrupt
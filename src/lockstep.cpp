@@ -0,0 +1,238 @@
+/**
+ * \brief       Lockstep differential execution
+ * \file        lockstep.cpp
+ * \copyright   LGPL v3
+ *
+ * Runs two Virtual Computers at the same time, one with the reference CPU
+ * core and other with an optimized core, and checks that they do the same
+ */
+
+#include "lockstep.hpp"
+#include "tr3200/tr3200.hpp"
+#include "tr3200/dis_tr3200.hpp"
+#include "dcpu16n/dcpu16n.hpp"
+#include "dcpu16n/dis_dcpu16n.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace trillek {
+namespace computer {
+
+Lockstep::Lockstep(VComputer& reference, VComputer& tested, LockstepCPU cpu,
+                   unsigned interval, unsigned full_interval) :
+    ref(reference), test(tested), cpu(cpu), interval(std::max(interval, 1u)),
+    full_interval(full_interval), ticks(0), checks(0), last_match(0),
+    first_check(true), diverged(false) {
+    ref.SetDirtyTracking(true);
+    test.SetDirtyTracking(true);
+}
+
+bool Lockstep::Run(uint64_t n) {
+    while (n > 0 && !diverged) {
+        const unsigned slice = (unsigned)std::min<uint64_t>(interval, n);
+        ref.Tick(slice);
+        test.Tick(slice);
+        ticks += slice;
+        n     -= slice;
+        Check();
+    }
+    return !diverged;
+} // Run
+
+bool Lockstep::Check(bool full) {
+    if (diverged) {
+        return false;
+    }
+    checks++;
+
+    // A write that skips the dirty tracking is found by the full compares
+    full = full || first_check || (full_interval > 0 && checks % full_interval == 0);
+
+    std::string what;
+    if ( !CompareState(what) || !CompareRAM(full, what) ) {
+        Diverge(what);
+        return false;
+    }
+    ref.ClearDirtyPages();
+    test.ClearDirtyPages();
+    first_check = false;
+    last_match  = ticks;
+    return true;
+} // Check
+
+/**
+ * Describes a different value
+ * \param name Name of the register
+ * \param index Index of the register on an array, or -1
+ * \param a Value on the reference
+ * \param b Value on the tested one
+ */
+static std::string Difference(const char* name, int index, DWord a, DWord b) {
+    char buf[128];
+    if (index >= 0) {
+        std::snprintf(buf, sizeof(buf), "%s[%d] : reference 0x%08X, test 0x%08X",
+                      name, index, a, b);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%s : reference 0x%08X, test 0x%08X",
+                      name, a, b);
+    }
+    return buf;
+}
+
+// Compares a field of the two states, and a field of an array
+#define LOCKSTEP_FIELD(f) \
+    if (a.f != b.f) { what = Difference(#f, -1, a.f, b.f); return false; }
+#define LOCKSTEP_ARRAY(f, n) \
+    for (int i = 0; i < (n); i++) { \
+        if (a.f[i] != b.f[i]) { what = Difference(#f, i, a.f[i], b.f[i]); return false; } \
+    }
+
+bool Lockstep::CompareState(std::string& what) const {
+    if (cpu == LOCKSTEP_TR3200) {
+        TR3200State a, b;
+        std::memset(&a, 0, sizeof(a));
+        std::memset(&b, 0, sizeof(b));
+        ref.GetState(&a, sizeof(a));
+        test.GetState(&b, sizeof(b));
+
+        LOCKSTEP_FIELD(pc)
+        LOCKSTEP_ARRAY(r, (int)TR3200::TR3200_NGPRS)
+        LOCKSTEP_FIELD(wait_cycles)
+        LOCKSTEP_FIELD(int_msg)
+        LOCKSTEP_FIELD(interrupt)
+        LOCKSTEP_FIELD(step_mode)
+        LOCKSTEP_FIELD(skiping)
+        LOCKSTEP_FIELD(sleeping)
+        return true;
+    }
+
+    DCPU16NState a, b;
+    std::memset(&a, 0, sizeof(a));
+    std::memset(&b, 0, sizeof(b));
+    ref.GetState(&a, sizeof(a));
+    test.GetState(&b, sizeof(b));
+
+    LOCKSTEP_FIELD(pc)
+    LOCKSTEP_ARRAY(r, 8)
+    LOCKSTEP_FIELD(sp)
+    LOCKSTEP_FIELD(ex)
+    LOCKSTEP_FIELD(ia)
+    LOCKSTEP_ARRAY(emu, 16)
+    LOCKSTEP_FIELD(phase)
+    LOCKSTEP_FIELD(phasenext)
+    LOCKSTEP_FIELD(wait_cycles)
+    LOCKSTEP_FIELD(pwrdraw)
+    LOCKSTEP_FIELD(addradd)
+    LOCKSTEP_FIELD(addrdec)
+    LOCKSTEP_FIELD(bytemode)
+    LOCKSTEP_FIELD(bytehigh)
+    LOCKSTEP_FIELD(skip)
+    LOCKSTEP_FIELD(fire)
+    LOCKSTEP_FIELD(qint)
+    LOCKSTEP_FIELD(iqp)
+    LOCKSTEP_FIELD(iqe)
+    LOCKSTEP_FIELD(iqc)
+    LOCKSTEP_ARRAY(intq, 256)
+    LOCKSTEP_FIELD(acu)
+    LOCKSTEP_FIELD(aca)
+    LOCKSTEP_FIELD(bcu)
+    LOCKSTEP_FIELD(bca)
+    LOCKSTEP_FIELD(opcl)
+    LOCKSTEP_FIELD(wrt)
+    LOCKSTEP_FIELD(fetchh)
+    return true;
+} // CompareState
+
+#undef LOCKSTEP_FIELD
+#undef LOCKSTEP_ARRAY
+
+bool Lockstep::CompareRAM(bool full, std::string& what) const {
+    if (ref.RamSize() != test.RamSize()) {
+        what = Difference("RAM size", -1, ref.RamSize(), test.RamSize());
+        return false;
+    }
+
+    std::vector<DWord> pages;
+    if (full) {
+        for (DWord addr = 0; addr < ref.RamSize(); addr += BusPageSize) {
+            pages.push_back(addr);
+        }
+    } else {
+        // Pages written by any of the two computers
+        pages = ref.GetDirtyPages();
+        const std::vector<DWord> test_pages = test.GetDirtyPages();
+        pages.insert(pages.end(), test_pages.begin(), test_pages.end());
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    }
+
+    const Byte* a = ref.Ram();
+    const Byte* b = test.Ram();
+    for (auto page : pages) {
+        const std::size_t size = std::min<std::size_t>(BusPageSize, ref.RamSize() - page);
+        if (std::memcmp(a + page, b + page, size) == 0) {
+            continue;
+        }
+        for (DWord addr = page; addr < page + size; addr++) {
+            if (a[addr] != b[addr]) {
+                char buf[128];
+                std::snprintf(buf, sizeof(buf), "RAM 0x%06X : reference 0x%02X, test 0x%02X",
+                              addr, a[addr], b[addr]);
+                what = buf;
+                return false;
+            }
+        }
+    }
+    return true;
+} // CompareRAM
+
+void Lockstep::Diverge(const std::string& what) {
+    diverged = true;
+    divergence.ticks      = ticks;
+    divergence.last_match = last_match;
+    divergence.what       = what;
+    divergence.ref_pc     = NextInstruction(ref, divergence.ref_inst);
+    divergence.test_pc    = NextInstruction(test, divergence.test_inst);
+}
+
+DWord Lockstep::NextInstruction(const VComputer& vc, std::string& inst) const {
+    if (cpu == LOCKSTEP_TR3200) {
+        TR3200State state;
+        vc.GetState(&state, sizeof(state));
+        inst = DisassemblyTR3200(vc, state.pc);
+        return state.pc;
+    }
+
+    // The disassembler wants the address translated by the EMU
+    DCPU16NState state;
+    vc.GetState(&state, sizeof(state));
+    const DWord addr = state.emu[(state.pc >> 12) & 0xf] | (state.pc & 0x0fff);
+    inst = DisassemblyDCPU16N(vc, addr);
+    return addr;
+}
+
+std::string Lockstep::Report() const {
+    if (!diverged) {
+        return "No divergence\n";
+    }
+
+    char buf[256];
+    std::string report;
+    std::snprintf(buf, sizeof(buf),
+                  "Divergence found after %llu ticks (last match at %llu ticks)\n",
+                  (unsigned long long)divergence.ticks,
+                  (unsigned long long)divergence.last_match);
+    report += buf;
+    report += "  " + divergence.what + "\n";
+    std::snprintf(buf, sizeof(buf), "  reference  0x%06X : ", divergence.ref_pc);
+    report += buf + divergence.ref_inst + "\n";
+    std::snprintf(buf, sizeof(buf), "  test       0x%06X : ", divergence.test_pc);
+    report += buf + divergence.test_inst + "\n";
+    return report;
+} // Report
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,101 @@
+/**
+ * \brief       Virtual Computer RAM image
+ * \file        ram_image.cpp
+ * \copyright   LGPL v3
+ *
+ * Read only snapshot of a Virtual Computer RAM
+ */
+
+#include "ram_image.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// memfd_create is available since Linux 3.17 / glibc 2.27
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+#define RAM_IMAGE_MEMFD 1
+#endif
+
+namespace trillek {
+namespace computer {
+
+RamImage::RamImage (const Byte* src, std::size_t size) :
+    size(size), data(nullptr), fd(-1) {
+    assert(src != nullptr);
+    assert(size > 0);
+
+#ifdef RAM_IMAGE_MEMFD
+    fd = memfd_create("trillek-vc-ram", MFD_CLOEXEC);
+    if (fd != -1 && ftruncate(fd, size) == 0) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            std::memcpy(p, src, size);
+            // From now, the image is read only
+            mprotect(p, size, PROT_READ);
+            data = (Byte*)p;
+            return;
+        }
+    }
+    // Fallback to a copy on the heap
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+
+    data = (Byte*)std::malloc(size);
+    if (data != nullptr) {
+        std::memcpy(data, src, size);
+    }
+}
+
+RamImage::~RamImage () {
+    if (data == nullptr) {
+        return;
+    }
+#ifdef RAM_IMAGE_MEMFD
+    if (fd != -1) {
+        munmap(data, size);
+        close(fd);
+        return;
+    }
+#endif
+    std::free(data);
+}
+
+Byte* RamImage::MapPrivate () const {
+    if (data == nullptr) {
+        return nullptr;
+    }
+#ifdef RAM_IMAGE_MEMFD
+    if (fd != -1) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        return (p != MAP_FAILED) ? (Byte*)p : nullptr;
+    }
+#endif
+    Byte* view = (Byte*)std::malloc(size);
+    if (view != nullptr) {
+        std::memcpy(view, data, size);
+    }
+    return view;
+}
+
+void RamImage::Unmap (Byte* view) const {
+    assert(view != nullptr);
+#ifdef RAM_IMAGE_MEMFD
+    if (fd != -1) {
+        munmap(view, size);
+        return;
+    }
+#endif
+    std::free(view);
+}
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -9,7 +9,10 @@
 
 #include "tr3200/tr3200.hpp"
 #include "tr3200/tr3200_opcodes.hpp"
+#include "tr3200/tr3200_isa.hpp"
 #include "tr3200/tr3200_macros.hpp"
+#include "tr3200/tr3200_jit.hpp"
+#include "code_profiler.hpp"
 #include "vs_fix.hpp"
 #include "config.hpp"
 
@@ -21,11 +24,35 @@
 namespace trillek {
 namespace computer {
 
-static const Byte cycle_table[] = { /// Lookup table for cycle count
-#include "tr3200/tr3200_cycles.inc"
-};
+// GCC and Clang could jump directly to the handler of each OpCode (computed
+// goto), instead of doing the bounds check of a switch. When TickLoop runs
+// the interpreter without profiler nor translator, each handler jumps to
+// the next one (see TR3200_NEXT)
+#if defined(__GNUC__) && !defined(TR3200_NO_COMPUTED_GOTO)
+#define TR3200_COMPUTED_GOTO 1
+#endif
+
+// Keeps the slow paths out of the interpreter loop
+#if defined(__GNUC__)
+#define TR3200_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define TR3200_NOINLINE __declspec(noinline)
+#else
+#define TR3200_NOINLINE
+#endif
+
+// Label of an OpCode handler, reachable from the switch and the dispatch table
+#ifdef TR3200_COMPUTED_GOTO
+#define HANDLER(type, op) case type::op: op_##op:
+#else
+#define HANDLER(type, op) case type::op:
+#endif
 
 TR3200::TR3200(unsigned clock) : ICPU(), cpu_clock(clock) {
+    DecodedInst empty = {};
+    empty.pc = ICACHE_INVALID;
+    icache.assign(ICACHE_SIZE, empty);
+    icache_pages.assign(BusPages, 0);
     this->Reset();
 }
 
@@ -44,13 +71,19 @@ void TR3200::Reset() {
     step_mode = false;
     skiping   = false;
     sleeping  = false;
+
+    lazy_flags = LAZY_NONE;
 } // Reset
 
 unsigned TR3200::Step() {
     assert (vcomp != nullptr);
 
     if (!sleeping) {
+        const DWord inst_pc = pc;
         unsigned cyc = RealStep();
+        if (profiler && cyc > 0) { // Not stopped by a breakpoint
+            profiler->Add(inst_pc, cyc);
+        }
         return cyc;
     }
     else {
@@ -59,30 +92,68 @@ unsigned TR3200::Step() {
     }
 } // Step
 
-void TR3200::Tick(unsigned n) {
+unsigned TR3200::Tick(unsigned n) {
     assert (vcomp != nullptr);
 
+    if (profiler) {
+        return TickLoop<true>(n);
+    }
+    return TickLoop<false>(n);
+} // Tick
+
+template <bool Profile>
+unsigned TR3200::TickLoop(unsigned n) {
     unsigned i = 0;
 
     while (i < n) {
-        if (!sleeping) {
-            if (wait_cycles <= 0 ) {
-                RealStep();
+        if (sleeping) {
+            ProcessInterrupt();
+            i++;
+            if (sleeping) {
+                return n; // Only an external interrupt could wake it
+            }
+            continue;
+        }
+
+        if (wait_cycles <= 0 ) {
+            if (!Profile && !jit) {
+                // Runs instructions until the cycles end, or the CPU
+                // sleeps or halts
+                i += Interpret<true>(n - i);
+                if ( vcomp->isHalted() ) {
+                    return i; // Breakpoint or watchpoint
+                }
+                continue;
+            }
+            if (jit && !Profile) {
+                const unsigned cycles = RunBlock(n - i);
+                if (cycles > 0) {
+                    i += cycles;
+                    continue;
+                }
+            }
+            const DWord inst_pc = pc;
+            const unsigned cycles = RealStep();
+            if (Profile && cycles > 0) {
+                profiler->Add(inst_pc, cycles);
             }
-#ifdef BRKPOINTS
             if ( vcomp->isHalted() ) {
-                return;
+                return i; // Breakpoint or watchpoint
             }
-#endif
+            // The first cycle of the instruction. A SLEEP must stop here
             wait_cycles--;
-        }
-        else {
-            ProcessInterrupt();
+            i++;
+            continue;
         }
 
-        i++;
+        // Remaining cycles of the instruction. If they not fit, the rest
+        // are done on the next call
+        const unsigned cycles = std::min(wait_cycles, n - i);
+        wait_cycles -= cycles;
+        i += cycles;
     }
-} // Tick
+    return n;
+} // TickLoop
 
 bool TR3200::SendInterrupt (Word msg) {
     if ( GET_EI(REG_FLAGS) && !GET_IF(REG_FLAGS)) {
@@ -95,734 +166,838 @@ bool TR3200::SendInterrupt (Word msg) {
     return false;
 }
 
+TR3200_NOINLINE void TR3200::PushDW (DWord val) {
+    const DWord addr = r[SP] - 4;
+    if ( addr < r[SP] && vcomp->isPlainRAM(addr, 4) ) {
+        vcomp->WriteDW(addr, val); // Little Endian
+        r[SP] = addr;
+        return;
+    }
+
+    // MMIO, watchpoints and SP wrapping around see the bytes one by one
+    vcomp->WriteB(--r[SP], val >> 24);
+    vcomp->WriteB(--r[SP], val >> 16);
+    vcomp->WriteB(--r[SP], val >> 8);
+    vcomp->WriteB(--r[SP], val); // Little Endian
+} // PushDW
+
 /**
  * Executes a TR3200 instruction
  * @return Number of cycles that takes to do it
  */
 unsigned TR3200::RealStep() {
-    //unsigned wait_cycles;
+    return Interpret<false>(1);
+} // RealStep
 
-#ifdef BRKPOINTS
-    if ( vcomp->isBreakPoint(pc) ) {
-        // Breakpoint !
-        return 0;
+inline bool TR3200::Retire (unsigned& i, unsigned n) {
+    if ( vcomp->isHalted() ) {
+        return false; // Breakpoint or watchpoint
+    }
+    // The first cycle of the instruction. A SLEEP must stop here
+    wait_cycles--;
+    i++;
+    if (sleeping) {
+        return false;
     }
+    const unsigned cycles = std::min(wait_cycles, n - i);
+    wait_cycles -= cycles;
+    i += cycles;
+    return i < n;
+} // Retire
+
+// Reads the operands of the decoded instruction, and advances the PC
+#define TR3200_OPERANDS \
+    pc += dec->length; \
+    rd          = dec->rd; \
+    rs          = dec->rs; \
+    opcode      = dec->opcode; \
+    wait_cycles = dec->cycles; \
+    literal     = (dec->flags & DEC_LITERAL) != 0
+
+// Threaded code : the tail of each handler ends the instruction and jumps
+// to the handler of the next one, so each handler has his own indirect jump
+// and the host predicts them by the previous instruction. Breakpoints,
+// skips, instructions not cached and instructions that need the real CF and
+// OF are left to the top of Interpret, so the tails are small
+#ifdef TR3200_COMPUTED_GOTO
+#define TR3200_NEXT \
+    if (Threaded) { \
+        step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS); \
+        if (interrupt) { \
+            ProcessInterrupt(); \
+        } \
+        if ( !Retire(i, n) ) { \
+            return i; \
+        } \
+        dec = &icache[(pc >> 2) & (ICACHE_SIZE - 1)]; \
+        if ( dec->pc != pc || (dec->flags & (DEC_BREAK | DEC_SYNC_FLAGS)) || skiping ) { \
+            goto next; \
+        } \
+        TR3200_OPERANDS; \
+        rn = dec->rn; \
+        if (dec->flags & DEC_RN_REG) { \
+            rn = r[rn]; \
+        } \
+        rs = r[rs]; \
+        goto *dispatch_table[dec->handler]; \
+    } \
+    break
+#else
+#define TR3200_NEXT break
 #endif
 
-    DWord inst = vcomp->ReadDW(pc);
-    pc += 4;
+/**
+ * Executes TR3200 instructions. If Threaded, runs instructions while they
+ * begin before n cycles, doing the cycles like TickLoop
+ * @param n Number of cycles that could be done (only if Threaded)
+ * @return Threaded : Number of cycles done. If not, cycles of the instruction
+ */
+template <bool Threaded>
+unsigned TR3200::Interpret(unsigned n) {
+    unsigned i = 0; // Cycles done
+    const DecodedInst* dec;
 
     DWord opcode, rd, rs, rn;
-    bool literal = HAVE_IMMEDIATE(inst);
-    bool big_literal = IS_BIG_LITERAL(inst);
+    bool literal;
 
     QWord ltmp;
 
-    rd          = GRD(inst);
-    rs          = GRS(inst);
-    opcode      = GET_OP_CODE(inst);
-    wait_cycles = cycle_table[opcode];
-
-    // Check if we are skiping a instruction
-    if (!skiping) {
-        if ( IS_P3(inst) ) {
-            // Processing of operands
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
-            }
-            else if (literal) {
-                rn = LIT14(inst);
-                if (SIGN_LIT14(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT14(rn);
-                }
-            }
-            else {
-                rn = r[GRN(inst)];
-            }
-
-            rs = r[rs];
-
-            switch (opcode) {
-            case P3_OPCODE::AND:
-                r[rd] = rs & rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::OR:
-                r[rd] = rs | rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::XOR:
-                r[rd] = rs ^ rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
+#ifdef TR3200_COMPUTED_GOTO
+    static const void* const dispatch_table[HANDLER_COUNT] = { /// Handlers
+        &&op_NOP, // Unknow OpCodes acts like a NOP
+#define TR3200_DISPATCH(name, ...) &&op_##name,
+        TR3200_INSTRUCTIONS(TR3200_DISPATCH)
+#undef TR3200_DISPATCH
+    };
+#endif
 
-            case P3_OPCODE::BITC:
-                r[rd] = rs & (~rn);
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
+next:
+    {
+        DecodedInst& cached = icache[(pc >> 2) & (ICACHE_SIZE - 1)];
+        dec = (cached.pc == pc) ? &cached : &Decode(pc);
+    }
 
+    if ( (dec->flags & DEC_BREAK) && vcomp->HitBreakPoint(pc) ) {
+        // Breakpoint !
+        return i;
+    }
+    TR3200_OPERANDS;
 
-            case P3_OPCODE::ADD:
-                ltmp = ( (QWord)rs ) + rn;
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
+    // Check if we are skiping a instruction
+    if (!skiping) {
+        // Instructions that use the FLAGS register, or the carry
+        if (dec->flags & DEC_SYNC_FLAGS) {
+            SyncFlags();
+        }
 
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::ADDC:
-                ltmp = ( (QWord)rs ) + rn + GET_CF(REG_FLAGS);
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
+        // Get rn value : big literal, short literal or register index
+        rn = dec->rn;
+        if (dec->flags & DEC_LIT_PENDING) {
+            rn = vcomp->Fetch<DWord>(pc - 4);
+        }
 
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::SUB:
-                ltmp = ( (QWord)rs ) - rn;
-                if (rs < rn) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
+        // P3 and P2 instructions use the value of the Rn register, and P3
+        // uses the value of the Rs register
+        if (dec->flags & DEC_RN_REG) {
+            rn = r[rn];
+        }
+        rs = r[rs];
 
-                // If operands have distint sign, check overflow
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::SUBB:
-                ltmp = ( (QWord)rs ) - ( rn + GET_CF(REG_FLAGS) );
-                if ( rs < ( rn + GET_CF(REG_FLAGS) ) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
+#ifdef TR3200_COMPUTED_GOTO
+        goto *dispatch_table[dec->handler];
+#endif
+        switch (opcode) {
+        HANDLER(P3_OPCODE, AND)
+            r[rd] = rs & rn;
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, OR)
+            r[rd] = rs | rn;
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, XOR)
+            r[rd] = rs ^ rn;
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, BITC)
+            r[rd] = rs & (~rn);
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, ADD)
+            // CF and OF are computed only when somebody reads them
+            SetLazyFlags(LAZY_ADD, rs, rn, 0, rd);
+            r[rd] = rs + rn;
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, ADDC)
+        {
+            const DWord cf = GET_CF(REG_FLAGS);
+            SetLazyFlags(LAZY_ADD, rs, rn, cf, rd);
+            r[rd] = rs + rn + cf;
+            TR3200_NEXT;
+        }
 
-                // If operands have distint sign, check overflow
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RSB:
-                ltmp = ( (QWord)rn ) - rs;
-                if (rn < rs) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
+        HANDLER(P3_OPCODE, SUB)
+            SetLazyFlags(LAZY_SUB, rs, rn, 0, rd);
+            r[rd] = rs - rn;
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, SUBB)
+        {
+            const DWord cf = GET_CF(REG_FLAGS);
+            SetLazyFlags(LAZY_SUB, rs, rn, cf, rd);
+            r[rd] = rs - (rn + cf);
+            TR3200_NEXT;
+        }
 
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RSBB:
-                ltmp = ( (QWord)rn ) - ( rs + GET_CF(REG_FLAGS) );
-                if ( rn < ( rs + GET_CF(REG_FLAGS) ) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
+        HANDLER(P3_OPCODE, RSB)
+            SetLazyFlags(LAZY_RSB, rn, rs, 0, rd);
+            r[rd] = rn - rs;
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, RSBB)
+        {
+            const DWord cf = GET_CF(REG_FLAGS);
+            SetLazyFlags(LAZY_RSB, rn, rs, cf, rd);
+            r[rd] = rn - (rs + cf);
+            TR3200_NEXT;
+        }
 
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::LLS:
-                ltmp = ( (QWord)rs ) << rn;
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RLS:
-                ltmp = ( (QWord)rs << 1 ) >> rn;
-                if (ltmp & 1) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)(ltmp >> 1);
-                break;
-
-            case P3_OPCODE::ARS:
-            {
-                SDWord srs = rs;
-                SDWord srn = rn;
-
-                SQWord result = ( ( (SQWord)srs ) << 1 ) >> srn; // Enforce
-                                                                     // to do
-                                                                     //
-                                                                     // arithmetic
-                                                                     // shift
-
-                if (result & 1) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)(result >> 1);
-                break;
+        HANDLER(P3_OPCODE, LLS)
+            ltmp = ( (QWord)rs ) << rn;
+            if ( CARRY_BIT(ltmp) ) {
+                // We grab output bit
+                SET_ON_CF(REG_FLAGS);
             }
-
-            case P3_OPCODE::ROTL:
-                r[rd]  = rs << (rn%32);
-                r[rd] |= rs >> (32 - (rn)%32);
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::ROTR:
-                r[rd]  = rs >> (rn%32);
-                r[rd] |= rs << (32 - (rn)%32);
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::MUL:
-                ltmp  = ( (QWord)rs ) * rn;
-                REG_Y = (DWord)(ltmp >> 32); // 32bit MSB of the 64 bit result
-                r[rd] = (DWord)ltmp;         // 32bit LSB of the 64 bit result
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::SMUL:
-            {
-                SQWord lword = (SQWord)rs;
-                lword *= rn;
-                REG_Y  = (DWord)(lword >> 32); // 32bit MSB of the 64 bit
-                                                 // result
-                r[rd] = (DWord)lword;          // 32bit LSB of the 64 bit
-                                                 // result
-                SET_OFF_OF(REG_FLAGS);
+            else {
                 SET_OFF_CF(REG_FLAGS);
-                break;
             }
-
-            case P3_OPCODE::DIV:
-                if (rn != 0) {
-                    r[rd] = rs / rn;
-                    REG_Y = rs % rn; // Compiler should optimize this and use a
-                                     // single instruction
-                }
-                else {
-                    // Division by 0
-                    SET_ON_DE(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
+            SET_OFF_OF(REG_FLAGS);
+            lazy_flags = LAZY_NONE;
+            r[rd] = (DWord)ltmp;
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, RLS)
+            ltmp = ( (QWord)rs << 1 ) >> rn;
+            if (ltmp & 1) {
+                // We grab output bit
+                SET_ON_CF(REG_FLAGS);
+            }
+            else {
                 SET_OFF_CF(REG_FLAGS);
-                break;
-
-
-            case P3_OPCODE::SDIV:
-            {
-                if (rn != 0) {
-                    SDWord srs    = rs;
-                    SDWord srn    = rn;
-                    SDWord result = srs / srn;
-                    r[rd]  = result;
-                    result = srs % srn;
-                    REG_Y  = result;
-                }
-                else {
-                    // Division by 0
-                    SET_ON_DE(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
+            }
+            SET_OFF_OF(REG_FLAGS);
+            lazy_flags = LAZY_NONE;
+            r[rd] = (DWord)(ltmp >> 1);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, ARS)
+        {
+            SDWord srs = rs;
+            SDWord srn = rn;
+
+            SQWord result = ( ( (SQWord)srs ) << 1 ) >> srn; // Enforce
+                                                                 // to do
+                                                                 //
+                                                                 // arithmetic
+                                                                 // shift
+
+            if (result & 1) {
+                // We grab output bit
+                SET_ON_CF(REG_FLAGS);
+            }
+            else {
                 SET_OFF_CF(REG_FLAGS);
-
-                break;
             }
+            SET_OFF_OF(REG_FLAGS);
+            lazy_flags = LAZY_NONE;
+            r[rd] = (DWord)(result >> 1);
+            TR3200_NEXT;
+        }
 
+        HANDLER(P3_OPCODE, ROTL)
+            r[rd]  = rs << (rn%32);
+            r[rd] |= rs >> (32 - (rn)%32);
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, ROTR)
+            r[rd]  = rs >> (rn%32);
+            r[rd] |= rs << (32 - (rn)%32);
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, MUL)
+            ltmp  = ( (QWord)rs ) * rn;
+            REG_Y = (DWord)(ltmp >> 32); // 32bit MSB of the 64 bit result
+            r[rd] = (DWord)ltmp;         // 32bit LSB of the 64 bit result
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, SMUL)
+        {
+            SQWord lword = (SQWord)rs;
+            lword *= rn;
+            REG_Y  = (DWord)(lword >> 32); // 32bit MSB of the 64 bit
+                                             // result
+            r[rd] = (DWord)lword;          // 32bit LSB of the 64 bit
+                                             // result
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+        }
 
-            case P3_OPCODE::LOAD:
-                r[rd] = vcomp->ReadDW(rs+rn);
-                break;
-
-            case P3_OPCODE::LOADW:
-                r[rd] = vcomp->ReadW(rs+rn);
-                break;
-
-            case P3_OPCODE::LOADB:
-                r[rd] = vcomp->ReadB(rs+rn);
-                break;
-
-            case P3_OPCODE::STORE:
-                vcomp->WriteDW(rs+rn, r[rd]);
-                break;
-
-            case P3_OPCODE::STOREW:
-                vcomp->WriteW(rs+rn, r[rd]);
-                break;
-
-            case P3_OPCODE::STOREB:
-                vcomp->WriteB(rs+rn, r[rd]);
-                break;
+        HANDLER(P3_OPCODE, DIV)
+            if (rn != 0) {
+                r[rd] = rs / rn;
+                REG_Y = rs % rn; // Compiler should optimize this and use a
+                                 // single instruction
+            }
+            else {
+                // Division by 0
+                SET_ON_DE(REG_FLAGS);
+            }
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, SDIV)
+        {
+            if (rn != 0) {
+                SDWord srs    = rs;
+                SDWord srn    = rn;
+                SDWord result = srs / srn;
+                r[rd]  = result;
+                result = srs % srn;
+                REG_Y  = result;
+            }
+            else {
+                // Division by 0
+                SET_ON_DE(REG_FLAGS);
+            }
+            lazy_flags = LAZY_LOGIC; // CF = OF = 0
 
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
+            TR3200_NEXT;
         }
-        else if ( IS_P2(inst) ) {
-            // 2 parameter instrucction
-            // *******************************************
-
-            // Fetch Rn operand
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
-            }
-            else if (literal) {
-                rn = LIT18(inst);
-                if (SIGN_LIT18(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT18(rn);
-                }
+
+        HANDLER(P3_OPCODE, LOAD)
+            r[rd] = vcomp->ReadDW(rs+rn);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, LOADW)
+            r[rd] = vcomp->ReadW(rs+rn);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, LOADB)
+            r[rd] = vcomp->ReadB(rs+rn);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, STORE)
+            vcomp->WriteDW(rs+rn, r[rd]);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, STOREW)
+            vcomp->WriteW(rs+rn, r[rd]);
+            TR3200_NEXT;
+
+        HANDLER(P3_OPCODE, STOREB)
+            vcomp->WriteB(rs+rn, r[rd]);
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, MOV)
+            r[rd] = rn;
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, SWP)
+            if (!literal) {
+                DWord tmp = r[rd];
+                r[rd]        = rn;
+                r[dec->rn]   = tmp;
+            } // If M != acts like a NOP
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, NOT)
+            r[rd] = ~rn;
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, SIGXB)
+            if ( (rn & 0x00000080) != 0 ) {
+                rd |= 0xFFFFFF00; // Negative
             }
             else {
-                rn = r[GRN(inst)];
+                rd &= 0x000000FF; // Positive
             }
+            TR3200_NEXT;
 
-            switch (opcode) {
-            case P2_OPCODE::MOV:
-                r[rd] = rn;
-                break;
-
-            case P2_OPCODE::SWP:
-                if (!literal) {
-                    DWord tmp = r[rd];
-                    r[rd]        = rn;
-                    r[GRN(inst)] = tmp;
-                } // If M != acts like a NOP
-                break;
+        HANDLER(P2_OPCODE, SIGXW)
+            if ( (rn & 0x00008000) != 0 ) {
+                rd |= 0xFFFF0000; // Negative
+            }
+            else {
+                rd &= 0x0000FFFF; // Positive
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::NOT:
-                r[rd] = ~rn;
-                break;
+        HANDLER(P2_OPCODE, LOAD2)
+            r[rd] = vcomp->ReadDW(rn);
+            TR3200_NEXT;
 
-            case P2_OPCODE::SIGXB:
-                if ( (rn & 0x00000080) != 0 ) {
-                    rd |= 0xFFFFFF00; // Negative
-                }
-                else {
-                    rd &= 0x000000FF; // Positive
-                }
-                break;
+        HANDLER(P2_OPCODE, LOADW2)
+            r[rd] = vcomp->ReadW(rn);
+            TR3200_NEXT;
 
-            case P2_OPCODE::SIGXW:
-                if ( (rn & 0x00008000) != 0 ) {
-                    rd |= 0xFFFF0000; // Negative
-                }
-                else {
-                    rd &= 0x0000FFFF; // Positive
-                }
-                break;
+        HANDLER(P2_OPCODE, LOADB2)
+            r[rd] = vcomp->ReadB(rn);
+            TR3200_NEXT;
 
-            case P2_OPCODE::LOAD2:
-                r[rd] = vcomp->ReadDW(rn);
-                break;
+        HANDLER(P2_OPCODE, STORE2)
+            vcomp->WriteDW(rn, r[rd]);
+            TR3200_NEXT;
 
-            case P2_OPCODE::LOADW2:
-                r[rd] = vcomp->ReadW(rn);
-                break;
+        HANDLER(P2_OPCODE, STOREW2)
+            vcomp->WriteW(rn, r[rd]);
+            TR3200_NEXT;
 
-            case P2_OPCODE::LOADB2:
-                r[rd] = vcomp->ReadB(rn);
-                break;
+        HANDLER(P2_OPCODE, STOREB2)
+            vcomp->WriteB(rn, r[rd]);
+            TR3200_NEXT;
 
-            case P2_OPCODE::STORE2:
-                vcomp->WriteDW(rn, r[rd]);
-                break;
+        HANDLER(P2_OPCODE, IFEQ)
+            if ( !(r[rd] == rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::STOREW2:
-                vcomp->WriteW(rn, r[rd]);
-                break;
+        HANDLER(P2_OPCODE, IFNEQ)
+            if ( !(r[rd] != rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::STOREB2:
-                vcomp->WriteB(rn, r[rd]);
-                break;
+        HANDLER(P2_OPCODE, IFL)
+            if ( !(r[rd] < rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, IFSL)
+        {
+            SDWord srd = r[rd];
+            SDWord srn = rn;
+            if ( !(srd < srn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+        }
 
+        HANDLER(P2_OPCODE, IFLE)
+            if ( !(r[rd] <= rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, IFSLE)
+        {
+            SDWord srd = r[rd];
+            SDWord srn = rn;
+            if ( !(srd <= srn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+        }
 
-            case P2_OPCODE::IFEQ:
-                if ( !(r[rd] == rn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, IFG)
+            if ( !(r[rd] > rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, IFSG)
+        {
+            SDWord srd = r[rd];
+            SDWord srn = rn;
+            if ( !(srd > srn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+        }
 
-            case P2_OPCODE::IFNEQ:
-                if ( !(r[rd] != rn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, IFGE)
+            if ( !(r[rd] >= rn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+
+        HANDLER(P2_OPCODE, IFSGE)
+        {
+            SDWord srd = r[rd];
+            SDWord srn = rn;
+            if ( !(srd >= srn) ) {
+                skiping = true;
+            }
+            TR3200_NEXT;
+        }
 
-            case P2_OPCODE::IFL:
-                if ( !(r[rd] < rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSL:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd < srn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, IFBITS)
+            if ( !( (r[rd] & rn) != 0 ) ) {
+                skiping = true;
             }
+            TR3200_NEXT;
 
-            case P2_OPCODE::IFLE:
-                if ( !(r[rd] <= rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSLE:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd <= srn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, IFCLEAR)
+            if ( !( (r[rd] & rn) == 0 ) ) {
+                skiping = true;
             }
+            TR3200_NEXT;
 
-            case P2_OPCODE::IFG:
-                if ( !(r[rd] > rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSG:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd > srn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, JMP2) // Absolute jump
+            if (literal) {
+                rn = rn << 2;
             }
+            pc = (r[rd] + rn) & 0xFFFFFFFC;
+            TR3200_NEXT;
 
-            case P2_OPCODE::IFGE:
-                if ( !(r[rd] >= rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSGE:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd >= srn) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P2_OPCODE, CALL2) // Absolute call
+            if (literal) {
+                rn = rn << 2;
             }
+            // push to the stack register pc value
+            PushDW(pc);
+            pc = (r[rd] + rn) & 0xFFFFFFFC;
+            TR3200_NEXT;
+
+        HANDLER(P1_OPCODE, XCHGB)
+            if (!literal) {
+                Word lob = (r[rn]  & 0xFF) << 8;
+                Word hib = (r[rn]  >> 8) & 0xFF;
+                r[rn] = (r[rn]  & 0xFFFF0000) | lob | hib;
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::IFBITS:
-                if ( !( (r[rd] & rn) != 0 ) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P1_OPCODE, XCHGW)
+            if (!literal) {
+                DWord low = r[rn] << 16;
+                DWord hiw = r[rn]  >> 16;
+                r[rn] = low | hiw;
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::IFCLEAR:
-                if ( !( (r[rd] & rn) == 0 ) ) {
-                    skiping = true;
-                }
-                break;
+        HANDLER(P1_OPCODE, GETPC)
+            if (!literal) {
+                r[rn] = pc; // PC is alredy pointing to the next instruction
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::JMP2: // Absolute jump
-                if (literal) {
-                    rn = rn << 2;
-                }
-                pc = (r[rd] + rn) & 0xFFFFFFFC;
-                break;
+        HANDLER(P1_OPCODE, POP)
+            if (!literal) {
+                // SP always points to the last pushed element
+                r[rn]  = vcomp->ReadDW(r[SP]);
+                r[SP] += 4;
+            }
+            TR3200_NEXT;
 
-            case P2_OPCODE::CALL2: // Absolute call
-                if (literal) {
-                    rn = rn << 2;
-                }
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                pc = (r[rd] + rn) & 0xFFFFFFFC;
-                break;
-
-
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
-        }
-        else if ( IS_P1(inst) ) {
-            // 1 parameter instrucction
-            // *******************************************
-
-            // Fetch Rn operand
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
-            }
-            else if (literal) {
-                rn = LIT22(inst);
-                if (SIGN_LIT22(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT22(rn);
-                }
+        HANDLER(P1_OPCODE, PUSH)
+            // SP always points to the last pushed element
+            if (!literal) {
+                rn = r[rn];
             }
-            else {
-                rn = GRN(inst);
+            PushDW(rn);
+            TR3200_NEXT;
+
+        HANDLER(P1_OPCODE, JMP) // Absolute jump
+            if (!literal) {
+                rn = r[rn];
+            } else {
+                rn = rn << 2;
             }
+            pc = rn & 0xFFFFFFFC;
+            TR3200_NEXT;
+
+        HANDLER(P1_OPCODE, CALL) // Absolute call
+            // push to the stack register pc value
+            PushDW(pc);
+            if (!literal) {
+                rn = r[rn];
+            } else {
+                rn = rn << 2;
+            }
+            pc = rn & 0xFFFFFFFC;
+            TR3200_NEXT;
+
+        HANDLER(P1_OPCODE, RJMP) // Relative jump
+            if (!literal) {
+                rn = r[rn];
+            } else {
+                rn = rn << 2;
+            }
+            pc = (pc + rn) & 0xFFFFFFFC;
+            TR3200_NEXT;
+
+        HANDLER(P1_OPCODE, RCALL) // Relative call
+            // push to the stack register pc value
+            PushDW(pc);
+            if (!literal) {
+                rn = r[rn];
+            } else {
+                rn = rn << 2;
+            }
+            pc = (pc + rn) & 0xFFFFFFFC;
+            TR3200_NEXT;
 
-            switch (opcode) {
-            case P1_OPCODE::XCHGB:
-                if (!literal) {
-                    Word lob = (r[rn]  & 0xFF) << 8;
-                    Word hib = (r[rn]  >> 8) & 0xFF;
-                    r[rn] = (r[rn]  & 0xFFFF0000) | lob | hib;
-                }
-                break;
-
-            case P1_OPCODE::XCHGW:
-                if (!literal) {
-                    DWord low = r[rn] << 16;
-                    DWord hiw = r[rn]  >> 16;
-                    r[rn] = low | hiw;
-                }
-                break;
+        HANDLER(P1_OPCODE, INT) // Software Interrupt
+            if (!literal) {
+                rn = r[rn];
+            }
+            SendInterrupt(rn);
+            TR3200_NEXT;
+
+        HANDLER(NP_OPCODE, SLEEP)
+            sleeping = true;
+            TR3200_NEXT;
+
+        HANDLER(NP_OPCODE, RET)
+            // Pop PC
+            pc     = vcomp->ReadDW(r[SP]);
+            r[SP] += 4;
+            pc    &= 0xFFFFFFFC;
+            TR3200_NEXT;
+
+        HANDLER(NP_OPCODE, RFI)
+            // Pop PC
+            pc     = vcomp->ReadDW(r[SP]);
+            r[SP] += 4;
+            pc    &= 0xFFFFFFFC;
+
+            // Pop %r0
+            r[0]   = vcomp->ReadDW(r[SP]);
+            r[SP] += 4;
+
+            SET_OFF_IF(REG_FLAGS);
+            interrupt = false; // We now not have a interrupt
+            TR3200_NEXT;
+
+        default:
+#ifdef TR3200_COMPUTED_GOTO
+        op_NOP:
+#endif
+            break; // Unknow OpCode -> Acts like a NOP (this could change)
+        } // switch
 
-            case P1_OPCODE::GETPC:
-                if (!literal) {
-                    r[rn] = pc; // PC is alredy pointing to the next instruction
-                }
-                break;
+        // Toggles Single Step mode
+        step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS);
 
+        ProcessInterrupt(); // Here we check if a interrupt happens
+    }
+    else {
+        // Skiping an instruction
+        wait_cycles = 1;
+        skiping     = false;
 
-            case P1_OPCODE::POP:
-                if (!literal) {
-                    // SP always points to the last pushed element
-                    r[rn]  = vcomp->ReadDW(r[SP]);
-                    r[SP] += 4;
-                }
-                break;
+        // PC already skiped the 32 bit immediate, if there is one
+        // Remove skiping flag if is not an IFxxx instruction
+        if (tr3200_isa[opcode].flags & ISA_BRANCH) {
+            skiping = true; // Chain IFxx
+        }
+    }
 
-            case P1_OPCODE::PUSH:
-                // SP always points to the last pushed element
-                if (!literal) {
-                    rn = r[rn];
-                }
-                vcomp->WriteB(--r[SP], rn >> 24);
-                vcomp->WriteB(--r[SP], rn >> 16);
-                vcomp->WriteB(--r[SP], rn >> 8 );
-                vcomp->WriteB(--r[SP], rn      );
-                break;
-
-
-            case P1_OPCODE::JMP: // Absolute jump
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = rn & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::CALL: // Absolute call
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = rn & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::RJMP: // Relative jump
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = (pc + rn) & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::RCALL: // Relative call
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = (pc + rn) & 0xFFFFFFFC;
-                break;
+    if (!Threaded) {
+        return wait_cycles;
+    }
+    if ( Retire(i, n) ) {
+        goto next;
+    }
+    return i;
+} // Interpret
+
+#undef TR3200_NEXT
+#undef TR3200_OPERANDS
+
+const TR3200::DecodedInst& TR3200::Decode (DWord addr) {
+    const DWord inst = vcomp->Fetch<DWord>(addr);
+
+    DecodedInst d;
+    d.pc      = addr;
+    d.opcode  = GET_OP_CODE(inst);
+    d.rd      = GRD(inst);
+    d.rs      = GRS(inst);
+    d.length  = 4;
+
+    static_assert(ISA_P3 == DEC_P3 && ISA_P2 == DEC_P2 && ISA_P1 == DEC_P1 && ISA_NP == DEC_NP,
+                  "Instruction types must be the DEC_xxx types");
+    const TR3200InstInfo& info = tr3200_isa[d.opcode];
+    d.cycles  = info.cycles;
+    d.handler = info.handler;
+    d.flags   = info.type | (HAVE_IMMEDIATE(inst) ? DEC_LITERAL : 0);
+
+    if ( info.type == ISA_P3 ) {
+        d.rn = LIT14(inst);
+        if (SIGN_LIT14(d.rn)) { // Negative Literal -> Extend sign
+            d.rn = NEG_LIT14(d.rn);
+        }
+    }
+    else if ( info.type == ISA_P2 ) {
+        d.rn = LIT18(inst);
+        if (SIGN_LIT18(d.rn)) {
+            d.rn = NEG_LIT18(d.rn);
+        }
+    }
+    else if ( info.type == ISA_P1 ) {
+        d.rn = LIT22(inst);
+        if (SIGN_LIT22(d.rn)) {
+            d.rn = NEG_LIT22(d.rn);
+        }
+    }
+    else {
+        d.rn = 0;
+    }
 
+    // Rd is a register on P3 and P2 instructions, and Rs only on P3. On
+    // P1 instructions they are part of the literal
+    if ( (info.type <= ISA_P2 && d.rd == FLAGS) || (info.type == ISA_P3 && d.rs == FLAGS) ||
+         (info.type != ISA_NP && !HAVE_IMMEDIATE(inst) && GRN(inst) == FLAGS) ||
+         (info.flags & ISA_CARRY) ) {
+        d.flags |= DEC_SYNC_FLAGS;
+    }
 
-            case P1_OPCODE::INT: // Software Interrupt
-                if (!literal) {
-                    rn = r[rn];
-                }
-                SendInterrupt(rn);
-                break;
+    // Setting or removing a breakpoint invalidates the cached instruction
+    if ( vcomp->isBreakPoint(addr) ) {
+        d.flags |= DEC_BREAK;
+    }
 
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
+    if ( !HAVE_IMMEDIATE(inst) ) {
+        d.rn = GRN(inst);
+        if ( info.type <= ISA_P2 ) {
+            d.flags |= DEC_RN_REG;
         }
-        else if ( IS_NP(inst) ) {
-            // Instructions without parameters
-            // ************************************
-
-            switch (opcode) {
-            case NP_OPCODE::SLEEP:
-                sleeping = true;
-                break;
-
-            case NP_OPCODE::RET:
-                // Pop PC
-                pc     = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
-                pc    &= 0xFFFFFFFC;
-                break;
+    }
+    else if ( IS_BIG_LITERAL(inst) && info.type != ISA_NP ) {
+        // Next dword is literal value
+        d.flags |= DEC_BIG_LITERAL;
+        d.length = 8;
+        d.cycles++;
+    }
 
-            case NP_OPCODE::RFI:
-                // Pop PC
-                pc     = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
-                pc    &= 0xFFFFFFFC;
+    // Only code from RAM or ROM could be cached. The VComputer will tell us
+    // if somebody writes over it
+    if ( addr < 0x1000000 && vcomp->WatchCode(addr, d.length) ) {
+        if (d.flags & DEC_BIG_LITERAL) {
+            d.rn = vcomp->Fetch<DWord>(addr + 4);
+        }
+        DecodedInst& entry = icache[(addr >> 2) & (ICACHE_SIZE - 1)];
+        if (entry.pc != ICACHE_INVALID) {
+            CountCode(entry, -1); // Evicted
+        }
+        entry = d;
+        CountCode(entry, 1);
+        return entry;
+    }
 
-                // Pop %r0
-                r[0]   = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
+    if (d.flags & DEC_BIG_LITERAL) {
+        d.flags |= DEC_LIT_PENDING; // Fetched only if is executed
+    }
+    uncached = d;
+    return uncached;
+} // Decode
+
+void TR3200::CountCode (const DecodedInst& entry, int inc) {
+    const DWord last = (entry.pc + entry.length - 1) >> BusPageShift;
+    for (DWord page = entry.pc >> BusPageShift; page <= last; page++) {
+        icache_pages[page] += inc;
+    }
+}
 
-                SET_OFF_IF(REG_FLAGS);
-                interrupt = false; // We now not have a interrupt
-                break;
+void TR3200::InvalidateCode (DWord addr, std::size_t size) {
+    if (jit) {
+        jit->Invalidate(addr, size);
+    }
 
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
+    // An instruction could begin up to 7 bytes before the address
+    const DWord first = (addr >= 7) ? addr - 7 : 0;
+    if (size >= ICACHE_SIZE * 4) {
+        for (auto& entry : icache) {
+            entry.pc = ICACHE_INVALID;
         }
+        std::fill(icache_pages.begin(), icache_pages.end(), 0);
+    }
+    else {
+        for (DWord a = first; a < addr + size; a++) {
+            DecodedInst& entry = icache[(a >> 2) & (ICACHE_SIZE - 1)];
+            if (entry.pc == a) {
+                CountCode(entry, -1);
+                entry.pc = ICACHE_INVALID;
+            }
+        }
+    }
 
-        // Toggles Single Step mode
-        step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS);
-
-        ProcessInterrupt(); // Here we check if a interrupt happens
+    // Written pages without cached code are not trapped anymore
+    const DWord last = (std::min<std::size_t>(addr + size, 0x1000000) - 1) >> BusPageShift;
+    for (DWord page = first >> BusPageShift; page <= last; page++) {
+        if (icache_pages[page] == 0 && (!jit || jit->Blocks(page) == 0)) {
+            vcomp->UnwatchCode(page << BusPageShift, BusPageSize);
+        }
+    }
+} // InvalidateCode
 
-        return wait_cycles;
+bool TR3200::SetCodeProfiling (bool enable) {
+    if (!enable) {
+        profiler.reset();
+    }
+    else if (!profiler) {
+        profiler.reset(new CodeProfiler());
     }
     else {
-        // Skiping an instruction
-        wait_cycles = 1;
-        skiping     = false;
+        profiler->Clear();
+    }
+    return profiler != nullptr;
+} // SetCodeProfiling
+
+inline void TR3200::SetLazyFlags (Byte op, DWord a, DWord b, DWord c, DWord rd) {
+    // If the result goes to FLAGS, it overwrites CF and OF
+    lazy_flags = (rd != FLAGS) ? op : LAZY_NONE;
+    lazy_a     = a;
+    lazy_b     = b;
+    lazy_c     = c;
+}
 
-        // if haves 32 bit immediate, then we need to increment PC
-        if ( (! IS_NP(inst)) && big_literal) {
-            // Big literal
-            pc += 4;
-        }
-        // Remove skiping flag if is not an IFxxx instruction
-        if ( IS_P2(inst) && IS_BRANCH(opcode) ) {
-            skiping = true; // Chain IFxx
-        }
+DWord TR3200::FlagsValue () const {
+    DWord res, cf, of_ref;
+    switch (lazy_flags) {
+    case LAZY_ADD:
+    {
+        const QWord ltmp = ( (QWord)lazy_a ) + lazy_b + lazy_c;
+        res    = (DWord)ltmp;
+        cf     = CARRY_BIT(ltmp);
+        of_ref = lazy_b;
+        break;
+    }
 
-        return wait_cycles;
+    case LAZY_SUB:
+    case LAZY_RSB:
+        res    = lazy_a - (lazy_b + lazy_c);
+        cf     = lazy_a < (lazy_b + lazy_c);
+        of_ref = (lazy_flags == LAZY_SUB) ? lazy_b : lazy_a; // Always Rn
+        break;
+
+    case LAZY_LOGIC:
+        return REG_FLAGS & ~3;
+
+    default:
+        return REG_FLAGS;
     }
-} // RealStep
+
+    // If operands have same sign, and Rn and the result have distint sign,
+    // there is an overflow
+    const DWord of = DW_SIGN_BIT(lazy_a) == DW_SIGN_BIT(lazy_b) &&
+                     DW_SIGN_BIT(of_ref) != DW_SIGN_BIT(res);
+    return (REG_FLAGS & ~3) | cf | (of << 1);
+} // FlagsValue
+
+TR3200_NOINLINE void TR3200::SyncFlags () {
+    REG_FLAGS  = FlagsValue();
+    lazy_flags = LAZY_NONE;
+}
 
 /**
  * Check if there is an interrupt to be procesed
@@ -840,16 +1015,10 @@ void TR3200::ProcessInterrupt() {
         }
 
         // push %r0
-        vcomp->WriteB(--r[SP], r[0] >> 24);
-        vcomp->WriteB(--r[SP], r[0] >> 16);
-        vcomp->WriteB(--r[SP], r[0] >> 8);
-        vcomp->WriteB(--r[SP], r[0]); // Little Endian
+        PushDW(r[0]);
 
         // push PC
-        vcomp->WriteB(--r[SP], pc >> 24);
-        vcomp->WriteB(--r[SP], pc >> 16);
-        vcomp->WriteB(--r[SP], pc >> 8);
-        vcomp->WriteB(--r[SP], pc); // Little Endian
+        PushDW(pc);
 
         r[0] = int_msg;
         pc   = addr;
@@ -872,6 +1041,7 @@ void TR3200::GetState (void* ptr, std::size_t& size) const {
     if ( ptr != nullptr && size >= sizeof(TR3200State) ) {
         TR3200State* state = (TR3200State*)ptr;
         std::copy_n(this->r, TR3200_NGPRS, state->r);
+        state->r[FLAGS] = FlagsValue();
         state->pc = this->pc;
 
         state->wait_cycles = this->wait_cycles;
@@ -894,6 +1064,7 @@ bool TR3200::SetState (const void* ptr, std::size_t size) {
     if ( ptr != nullptr && size >= sizeof(TR3200State) ) {
         const TR3200State* state = (const TR3200State*)ptr;
         std::copy_n(state->r, TR3200_NGPRS, this->r);
+        this->lazy_flags = LAZY_NONE;
         this->pc = state->pc;
 
         this->wait_cycles = state->wait_cycles;
@@ -0,0 +1,76 @@
+/**
+ * \brief       TR3200 instruction set tables
+ * \file        tr3200_isa.cpp
+ * \copyright   LGPL v3
+ *
+ * Metadata of each TR3200 OpCode, generated at compile time from the
+ * instruction descriptions of tr3200_opcodes.hpp
+ */
+
+#include "tr3200/tr3200_isa.hpp"
+
+namespace trillek {
+namespace computer {
+
+// Checks of the instruction descriptions, done by the compiler ***************
+
+/**
+ * Nº of instructions described with an OpCode
+ */
+constexpr unsigned TR3200InstCount(unsigned opcode) {
+#define TR3200_INST_COUNT(name, op, ...) (opcode == op ? 1u : 0u) +
+    return TR3200_INSTRUCTIONS(TR3200_INST_COUNT) 0u;
+#undef TR3200_INST_COUNT
+}
+
+/**
+ * Checks that none OpCode is described twice
+ */
+constexpr bool TR3200UniqueOpCodes(unsigned opcode = 0) {
+    return opcode > 0xFF ||
+           (TR3200InstCount(opcode) <= 1 && TR3200UniqueOpCodes(opcode + 1));
+}
+
+static_assert(TR3200UniqueOpCodes(), "TR3200 OpCode described twice");
+
+// Each list must only have OpCodes of his type
+#define TR3200_CHECK_TYPE(name, op, ...) \
+    static_assert(TR3200Type(op) == ISA_TYPE, #name " is on the wrong list");
+#define ISA_TYPE ISA_P3
+TR3200_P3_INSTRUCTIONS(TR3200_CHECK_TYPE)
+#undef ISA_TYPE
+#define ISA_TYPE ISA_P2
+TR3200_P2_INSTRUCTIONS(TR3200_CHECK_TYPE)
+#undef ISA_TYPE
+#define ISA_TYPE ISA_P1
+TR3200_P1_INSTRUCTIONS(TR3200_CHECK_TYPE)
+#undef ISA_TYPE
+#define ISA_TYPE ISA_NP
+TR3200_NP_INSTRUCTIONS(TR3200_CHECK_TYPE)
+#undef ISA_TYPE
+#undef TR3200_CHECK_TYPE
+
+// The table ******************************************************************
+
+#define TR3200_ISA_ROW(x) \
+    TR3200Inst(x + 0x0), TR3200Inst(x + 0x1), TR3200Inst(x + 0x2), \
+    TR3200Inst(x + 0x3), TR3200Inst(x + 0x4), TR3200Inst(x + 0x5), \
+    TR3200Inst(x + 0x6), TR3200Inst(x + 0x7), TR3200Inst(x + 0x8), \
+    TR3200Inst(x + 0x9), TR3200Inst(x + 0xA), TR3200Inst(x + 0xB), \
+    TR3200Inst(x + 0xC), TR3200Inst(x + 0xD), TR3200Inst(x + 0xE), \
+    TR3200Inst(x + 0xF)
+
+// All are constant expressions, so the table is filled by the compiler
+const TR3200InstInfo tr3200_isa[256] = {
+    TR3200_ISA_ROW(0x00), TR3200_ISA_ROW(0x10), TR3200_ISA_ROW(0x20),
+    TR3200_ISA_ROW(0x30), TR3200_ISA_ROW(0x40), TR3200_ISA_ROW(0x50),
+    TR3200_ISA_ROW(0x60), TR3200_ISA_ROW(0x70), TR3200_ISA_ROW(0x80),
+    TR3200_ISA_ROW(0x90), TR3200_ISA_ROW(0xA0), TR3200_ISA_ROW(0xB0),
+    TR3200_ISA_ROW(0xC0), TR3200_ISA_ROW(0xD0), TR3200_ISA_ROW(0xE0),
+    TR3200_ISA_ROW(0xF0),
+};
+
+#undef TR3200_ISA_ROW
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,117 @@
+/**
+ * \brief       TR3200 instruction set tables
+ * \file        tr3200_isa.hpp
+ * \copyright   LGPL v3
+ *
+ * Metadata of each TR3200 OpCode, generated at compile time from the
+ * instruction descriptions of tr3200_opcodes.hpp
+ */
+#ifndef __TR3200_ISA_HPP_
+#define __TR3200_ISA_HPP_ 1
+
+#include "types.hpp"
+#include "tr3200/tr3200_opcodes.hpp"
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Instruction types. The values are the same that the TR3200 DEC_xxx types
+ */
+enum TR3200_TYPE {
+    ISA_P3 = 0, /// 3 parameters instruction
+    ISA_P2 = 1, /// 2 parameters instruction
+    ISA_P1 = 2, /// 1 parameter instruction
+    ISA_NP = 3, /// Instruction without parameters
+};
+
+/**
+ * Kind of operands of an instruction. Rn could be a register or a literal
+ */
+enum TR3200_OPERANDS {
+    OPS_NONE,        /// OP
+    OPS_RD_RS_RN,    /// OP %rd, %rs, rn
+    OPS_LOAD_RS_RN,  /// OP %rd, [%rs + rn]
+    OPS_STORE_RS_RN, /// OP [%rs + rn], %rd
+    OPS_RD_RN,       /// OP %rd, rn
+    OPS_LOAD_RN,     /// OP %rd, [rn]
+    OPS_STORE_RN,    /// OP [rn], %rd
+    OPS_RD_OFFSET,   /// OP %rd + rn*4
+    OPS_REG,         /// OP %rn (only register)
+    OPS_RN,          /// OP rn
+    OPS_ADDRESS,     /// OP rn*4
+    OPS_PC_OFFSET,   /// OP %pc + rn
+    OPS_INT,         /// OP rn (interrupt message)
+};
+
+static Byte const ISA_BRANCH = 0x01; /// Conditional, skips the next instruction
+static Byte const ISA_CARRY  = 0x02; /// Reads the carry flag
+static Byte const ISA_READ   = 0x04; /// Reads from memory
+static Byte const ISA_WRITE  = 0x08; /// Writes to memory
+static Byte const ISA_STACK  = 0x10; /// Pushes or pops from the stack
+static Byte const ISA_JUMP   = 0x20; /// Changes the PC
+
+/**
+ * Index of the handler of each instruction. Unknow OpCodes use the NOP
+ * handler
+ */
+enum TR3200_HANDLER {
+    HANDLER_NOP = 0,
+#define TR3200_HANDLER_ENUM(name, ...) HANDLER_##name,
+    TR3200_INSTRUCTIONS(TR3200_HANDLER_ENUM)
+#undef TR3200_HANDLER_ENUM
+    HANDLER_COUNT
+};
+
+/**
+ * Metadata of an OpCode
+ */
+struct TR3200InstInfo {
+    const char* mnemonic; /// Name used by the disassembler
+    Byte type;            /// ISA_xxx instruction type
+    Byte cycles;          /// Base cycles, without the big literal fetch
+    Byte operands;        /// OPS_xxx kind of operands
+    Byte flags;           /// ISA_xxx flags
+    Byte handler;         /// HANDLER_xxx index of the interpreter handler
+};
+
+/**
+ * Instruction type in function of the OpCode
+ */
+constexpr Byte TR3200Type(unsigned opcode) {
+    return opcode >= 0x80 ? ISA_P3 : opcode >= 0x40 ? ISA_P2 :
+           opcode >= 0x20 ? ISA_P1 : ISA_NP;
+}
+
+/**
+ * Metadata of an unknow OpCode. Acts like a NOP
+ */
+constexpr TR3200InstInfo TR3200UnknowInst(unsigned opcode) {
+    return TR3200InstInfo{ "????", TR3200Type(opcode), 1,
+        Byte(TR3200Type(opcode) == ISA_P3 ? OPS_RD_RS_RN :
+             TR3200Type(opcode) == ISA_P2 ? OPS_RD_RN :
+             TR3200Type(opcode) == ISA_P1 ? OPS_RN : OPS_NONE),
+        0, HANDLER_NOP };
+}
+
+/**
+ * Metadata of an OpCode, searched at compile time on the instruction
+ * descriptions
+ */
+constexpr TR3200InstInfo TR3200Inst(unsigned opcode) {
+#define TR3200_INST_INFO(name, op, cycles, operands, flags, mnemonic) \
+    opcode == op ? TR3200InstInfo{ mnemonic, TR3200Type(op), cycles, \
+                                   operands, flags, HANDLER_##name } :
+    return TR3200_INSTRUCTIONS(TR3200_INST_INFO) TR3200UnknowInst(opcode);
+#undef TR3200_INST_INFO
+}
+
+/**
+ * Metadata of the 256 OpCodes
+ */
+extern const TR3200InstInfo tr3200_isa[256];
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TR3200_ISA_HPP_
@@ -0,0 +1,462 @@
+/**
+ * \brief       TR3200 basic block translator
+ * \file        tr3200_jit.cpp
+ * \copyright   LGPL v3
+ *
+ * Translation of TR3200 basic blocks to native x86-64 code
+ */
+
+#include "tr3200/tr3200.hpp"
+#include "tr3200/tr3200_jit.hpp"
+#include "tr3200/tr3200_opcodes.hpp"
+#include "tr3200/tr3200_macros.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef TR3200_JIT
+#include <sys/mman.h>
+#endif
+
+namespace trillek {
+namespace computer {
+
+TR3200Jit::TR3200Jit () : buffer(nullptr), used(0), start(0), writable(false) {
+    Block empty = {INVALID, INVALID, 0, nullptr};
+    table.assign(TABLE_SIZE, empty);
+    page_slots.resize(BusPages);
+
+#ifdef TR3200_JIT
+    // Never writable and executable at the same time (W^X), so the buffer
+    // is mapped RW and switched to RX after emitting each block
+    void* p = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+        buffer = (Byte*)p;
+        writable = true;
+        Protect(false); // Checks that the OS lets us execute it
+    }
+#endif
+}
+
+TR3200Jit::~TR3200Jit () {
+    Release();
+}
+
+void TR3200Jit::Release () {
+#ifdef TR3200_JIT
+    if (buffer != nullptr) {
+        munmap(buffer, CODE_SIZE);
+    }
+#endif
+    buffer = nullptr;
+    Flush(); // Blocks point to the released buffer
+}
+
+bool TR3200Jit::Protect (bool write) {
+#ifdef TR3200_JIT
+    if (buffer == nullptr) {
+        return false;
+    }
+    if (write != writable) {
+        const int prot = write ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC);
+        if (mprotect(buffer, CODE_SIZE, prot) != 0) {
+            Release(); // SELinux execmem, PaX... The interpreter must do it
+            return false;
+        }
+        writable = write;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TR3200Jit::Begin () {
+    if ( !Protect(true) ) {
+        return false;
+    }
+    if (CODE_SIZE - used < MAX_BLOCK_CODE) {
+        Flush();
+    }
+    start = used;
+    return true;
+}
+
+TR3200Jit::Block& TR3200Jit::End (DWord pc, DWord end, unsigned cycles, unsigned ninsts) {
+    Block& entry = Entry(pc);
+    const Word slot = &entry - table.data();
+    if (entry.pc != INVALID) {
+        Unlink(slot); // Evicted
+    }
+
+    entry.pc     = pc;
+    entry.end    = end;
+    entry.cycles = cycles;
+    if (ninsts > 0) {
+        Emit(0xC3); // ret
+        entry.code = reinterpret_cast<BlockFn>(buffer + start);
+    }
+    else {
+        used       = start; // Nothing to keep
+        entry.code = nullptr;
+    }
+    Link(slot);
+    if ( !Protect(false) ) {
+        entry.code = nullptr; // Can't be executed
+    }
+    return entry;
+}
+
+void TR3200Jit::Link (Word slot) {
+    const Block& block = table[slot];
+    const DWord last = std::min((block.end - 1) >> BusPageShift, BusPages - 1);
+    for (DWord page = block.pc >> BusPageShift; page <= last; page++) {
+        page_slots[page].push_back(slot);
+    }
+}
+
+void TR3200Jit::Unlink (Word slot) {
+    const Block& block = table[slot];
+    const DWord last = std::min((block.end - 1) >> BusPageShift, BusPages - 1);
+    for (DWord page = block.pc >> BusPageShift; page <= last; page++) {
+        std::vector<Word>& slots = page_slots[page];
+        auto it = std::find(slots.begin(), slots.end(), slot);
+        assert(it != slots.end());
+        *it = slots.back();
+        slots.pop_back();
+    }
+}
+
+void TR3200Jit::Invalidate (DWord addr, std::size_t size) {
+    if (size == 0 || addr >= BusPages << BusPageShift) {
+        return;
+    }
+    const std::size_t end = std::min<std::size_t>(addr + size, BusPages << BusPageShift);
+    const DWord first_page = addr >> BusPageShift;
+    const DWord last_page = (end - 1) >> BusPageShift;
+    if (last_page - first_page >= 16) {
+        Flush();
+        return;
+    }
+
+    // Only the blocks of the written pages are visited. Unlink swaps the
+    // last entry of the list into the removed one, so we walk backwards
+    for (DWord page = first_page; page <= last_page; page++) {
+        std::vector<Word>& slots = page_slots[page];
+        for (std::size_t i = slots.size(); i-- > 0; ) {
+            const Word slot = slots[i];
+            Block& block = table[slot];
+            if (block.pc < end && addr < block.end) {
+                Unlink(slot);
+                block.pc = INVALID;
+            }
+        }
+    }
+}
+
+void TR3200Jit::Flush () {
+    for (auto& block : table) {
+        block.pc = INVALID;
+    }
+    for (auto& slots : page_slots) {
+        slots.clear();
+    }
+    used = 0;
+}
+
+void TR3200Jit::Emit (Byte b) {
+    buffer[used++] = b;
+}
+
+void TR3200Jit::Emit (Byte b0, Byte b1) {
+    Emit(b0);
+    Emit(b1);
+}
+
+void TR3200Jit::Emit (Byte b0, Byte b1, Byte b2) {
+    Emit(b0);
+    Emit(b1);
+    Emit(b2);
+}
+
+void TR3200Jit::Emit32 (DWord v) {
+    Emit(v, v >> 8);
+    Emit(v >> 16, v >> 24);
+}
+
+void TR3200Jit::LoadReg (Byte reg, unsigned idx) {
+    Emit(0x8B, 0x47 | (reg << 3), idx * 4);
+}
+
+void TR3200Jit::StoreReg (Byte reg, unsigned idx) {
+    Emit(0x89, 0x47 | (reg << 3), idx * 4);
+}
+
+void TR3200Jit::LoadImm (Byte reg, DWord v) {
+    Emit(0xB8 + reg);
+    Emit32(v);
+}
+
+bool TR3200::SetJIT (bool enable) {
+    if (!enable) {
+        jit.reset();
+        return false;
+    }
+    if (!jit) {
+        jit.reset(new TR3200Jit());
+        if (!jit->isValid()) {
+            jit.reset(); // No executable memory or not a x86-64 host
+        }
+    }
+    return isJIT();
+}
+
+unsigned TR3200::RunBlock (unsigned max_cycles) {
+    // Interrupts and skips are handled only by the interpreter
+    if (skiping || interrupt) {
+        return 0;
+    }
+
+    const TR3200Jit::Block* block = &jit->Entry(pc);
+    if (block->pc != pc) {
+        Translate(pc);
+        if ( !jit->isValid() ) {
+            jit.reset(); // Can't make the code executable. Interpreter only
+            return 0;
+        }
+        block = &jit->Entry(pc);
+    }
+    if (block->code == nullptr || block->cycles > max_cycles) {
+        return 0;
+    }
+
+    SyncFlags(); // Blocks work over the FLAGS register
+    block->code(r);
+    pc        = block->end;
+    step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS);
+    return block->cycles;
+} // RunBlock
+
+void TR3200::Translate (DWord addr) {
+    if ( !jit->Begin() ) {
+        return; // The code buffer was lost
+    }
+
+    DWord end = addr;
+    unsigned cycles = 0;
+    unsigned ninsts = 0;
+    while (ninsts < TR3200Jit::MAX_INSTS) {
+        // Don't fetch from pages that are watched or profiled
+        if ( end >= 0x1000000 || !vcomp->WatchCode(end, 4) ) {
+            break;
+        }
+        const DecodedInst& cached = Decode(end);
+        if (&cached == &uncached) {
+            break;
+        }
+        if (cached.flags & DEC_BREAK) {
+            break; // Breakpoints are handled only by the interpreter
+        }
+        const DecodedInst dec = cached; // Next Decode could evict it
+        const std::size_t mark = jit->Used();
+        if ( !EmitInst(dec) ) {
+            jit->Rewind(mark);
+            break; // Needs the interpreter
+        }
+        end    += dec.length;
+        cycles += dec.cycles;
+        ninsts++;
+    }
+
+    jit->End(addr, ninsts > 0 ? end : addr + 4, cycles, ninsts);
+} // Translate
+
+bool TR3200::EmitInst (const DecodedInst& dec) {
+    TR3200Jit& e = *jit;
+    const Byte EAX = TR3200Jit::EAX;
+    const Byte ECX = TR3200Jit::ECX;
+    const Byte EDX = TR3200Jit::EDX;
+    const Byte ESI = TR3200Jit::ESI;
+    const bool literal = (dec.flags & DEC_LITERAL) != 0;
+
+    if (dec.rd == FLAGS) {
+        return false; // Could change EI or ESS
+    }
+
+    if ( (dec.flags & DEC_TYPE) == DEC_P2 ) {
+        switch (dec.opcode) {
+        case P2_OPCODE::MOV:
+        case P2_OPCODE::NOT:
+            if (dec.flags & DEC_RN_REG) {
+                e.LoadReg(EAX, dec.rn);
+            }
+            else {
+                e.LoadImm(EAX, dec.rn);
+            }
+            if (dec.opcode == P2_OPCODE::NOT) {
+                e.Emit(0xF7, 0xD0);                     // not eax
+            }
+            e.StoreReg(EAX, dec.rd);
+            return true;
+
+        case P2_OPCODE::SWP:
+            if (literal || dec.rn == FLAGS) {
+                return false;
+            }
+            e.LoadReg(EAX, dec.rd);
+            e.LoadReg(ECX, dec.rn);
+            e.StoreReg(ECX, dec.rd);
+            e.StoreReg(EAX, dec.rn);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    if ( (dec.flags & DEC_TYPE) != DEC_P3 ) {
+        return false;
+    }
+
+    // esi = Rs, edx = Rn
+    e.LoadReg(ESI, dec.rs);
+    if (dec.flags & DEC_RN_REG) {
+        e.LoadReg(EDX, dec.rn);
+    }
+    else {
+        e.LoadImm(EDX, dec.rn);
+    }
+
+    switch (dec.opcode) {
+    case P3_OPCODE::AND:
+    case P3_OPCODE::OR:
+    case P3_OPCODE::XOR:
+    case P3_OPCODE::BITC:
+    case P3_OPCODE::MUL:
+        e.Emit(0x89, 0xF0);                             // mov eax, esi
+        if (dec.opcode == P3_OPCODE::AND) {
+            e.Emit(0x21, 0xD0);                         // and eax, edx
+        }
+        else if (dec.opcode == P3_OPCODE::OR) {
+            e.Emit(0x09, 0xD0);                         // or eax, edx
+        }
+        else if (dec.opcode == P3_OPCODE::XOR) {
+            e.Emit(0x31, 0xD0);                         // xor eax, edx
+        }
+        else if (dec.opcode == P3_OPCODE::BITC) {
+            e.Emit(0xF7, 0xD2);                         // not edx
+            e.Emit(0x21, 0xD0);                         // and eax, edx
+        }
+        else {
+            e.Emit(0xF7, 0xE2);                         // mul edx
+            e.StoreReg(EDX, RY);
+        }
+        e.StoreReg(EAX, dec.rd);
+        e.Emit(0x83, 0x67, FLAGS * 4);                  // and [flags], ~(CF|OF)
+        e.Emit(0xFC);
+        return true;
+
+    case P3_OPCODE::ADD:
+    case P3_OPCODE::ADDC:
+        e.Emit(0x89, 0xF0);                             // mov eax, esi
+        if (dec.opcode == P3_OPCODE::ADDC) {
+            e.LoadReg(ECX, FLAGS);
+            e.Emit(0x83, 0xE1, 0x01);                   // and ecx, 1
+            e.Emit(0x48, 0x01, 0xC8);                   // add rax, rcx
+        }
+        e.Emit(0x48, 0x01, 0xD0);                       // add rax, rdx
+        e.Emit(0x48, 0x89, 0xC1);                       // mov rcx, rax
+        e.Emit(0x48, 0xC1, 0xE9); e.Emit(32);           // shr rcx, 32
+        break;
+
+    case P3_OPCODE::SUB:
+    case P3_OPCODE::RSB:
+        if (dec.opcode == P3_OPCODE::SUB) {
+            e.Emit(0x89, 0xF0);                         // mov eax, esi
+            e.Emit(0x29, 0xD0);                         // sub eax, edx
+        }
+        else {
+            e.Emit(0x89, 0xD0);                         // mov eax, edx
+            e.Emit(0x29, 0xF0);                         // sub eax, esi
+        }
+        e.Emit(0x0F, 0x92, 0xC1);                       // setb cl
+        e.Emit(0x0F, 0xB6, 0xC9);                       // movzx ecx, cl
+        break;
+
+    case P3_OPCODE::SUBB:
+    case P3_OPCODE::RSBB:
+        // The borrow is added to the subtrahend, wrapping at 32 bits
+        e.LoadReg(ECX, FLAGS);
+        e.Emit(0x83, 0xE1, 0x01);                       // and ecx, 1
+        if (dec.opcode == P3_OPCODE::SUBB) {
+            e.Emit(0x01, 0xD1);                         // add ecx, edx
+            e.Emit(0x89, 0xF0);                         // mov eax, esi
+        }
+        else {
+            e.Emit(0x01, 0xF1);                         // add ecx, esi
+            e.Emit(0x89, 0xD0);                         // mov eax, edx
+        }
+        e.Emit(0x29, 0xC8);                             // sub eax, ecx
+        e.Emit(0x0F, 0x92, 0xC1);                       // setb cl
+        e.Emit(0x0F, 0xB6, 0xC9);                       // movzx ecx, cl
+        break;
+
+    case P3_OPCODE::LLS:
+    case P3_OPCODE::RLS:
+    case P3_OPCODE::ARS:
+        // Shifts of 32 or more bits are left to the interpreter
+        if (!literal || dec.rn >= 32) {
+            return false;
+        }
+        if (dec.opcode == P3_OPCODE::LLS) {
+            e.Emit(0x89, 0xF0);                         // mov eax, esi
+            e.Emit(0x48, 0xC1, 0xE0); e.Emit(dec.rn);   // shl rax, rn
+            e.Emit(0x48, 0x89, 0xC1);                   // mov rcx, rax
+            e.Emit(0x48, 0xC1, 0xE9); e.Emit(32);       // shr rcx, 32
+        }
+        else {
+            if (dec.opcode == P3_OPCODE::RLS) {
+                e.Emit(0x89, 0xF0);                     // mov eax, esi
+                e.Emit(0x48, 0xD1, 0xE0);               // shl rax, 1
+                e.Emit(0x48, 0xC1, 0xE8); e.Emit(dec.rn); // shr rax, rn
+            }
+            else {
+                e.Emit(0x48, 0x63, 0xC6);               // movsxd rax, esi
+                e.Emit(0x48, 0xD1, 0xE0);               // shl rax, 1
+                e.Emit(0x48, 0xC1, 0xF8); e.Emit(dec.rn); // sar rax, rn
+            }
+            e.Emit(0x89, 0xC1);                         // mov ecx, eax
+            e.Emit(0x48, 0xD1, 0xE8);                   // shr rax, 1
+        }
+        e.Emit(0x83, 0xE1, 0x01);                       // and ecx, 1
+        e.StoreReg(EAX, dec.rd);
+        e.LoadReg(EAX, FLAGS);
+        e.Emit(0x83, 0xE0, 0xFC);                       // and eax, ~(CF|OF)
+        e.Emit(0x09, 0xC8);                             // or eax, ecx
+        e.StoreReg(EAX, FLAGS);
+        return true;
+
+    default:
+        return false;
+    }
+
+    // Additions and subtractions : eax = result, ecx = CF
+    e.StoreReg(EAX, dec.rd);
+    // OF = Rs and Rn have the same sign, and Rn and the result not
+    e.Emit(0x31, 0xD0);                                 // xor eax, edx
+    e.Emit(0x31, 0xD6);                                 // xor esi, edx
+    e.Emit(0xF7, 0xD6);                                 // not esi
+    e.Emit(0x21, 0xF0);                                 // and eax, esi
+    e.Emit(0xC1, 0xE8, 30);                             // shr eax, 30
+    e.Emit(0x83, 0xE0, 0x02);                           // and eax, 2
+    e.Emit(0x09, 0xC1);                                 // or ecx, eax
+    e.LoadReg(EAX, FLAGS);
+    e.Emit(0x83, 0xE0, 0xFC);                           // and eax, ~(CF|OF)
+    e.Emit(0x09, 0xC8);                                 // or eax, ecx
+    e.StoreReg(EAX, FLAGS);
+    return true;
+} // EmitInst
+
+} // End of namespace computer
+} // End of namespace trillek
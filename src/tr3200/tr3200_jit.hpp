@@ -0,0 +1,177 @@
+/**
+ * \brief       TR3200 basic block translator
+ * \file        tr3200_jit.hpp
+ * \copyright   LGPL v3
+ *
+ * Translation of TR3200 basic blocks to native x86-64 code
+ */
+#ifndef __TR3200_JIT_HPP_
+#define __TR3200_JIT_HPP_ 1
+
+#include "types.hpp"
+
+#include <vector>
+#include <cstddef>
+
+// Only x86-64 hosts with mmap could run the translated code
+#if defined(__x86_64__) && defined(__linux__)
+#define TR3200_JIT 1
+#endif
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Code buffer and block table of the TR3200 translator.
+ * A block is a run of instructions that only work over the CPU registers,
+ * so it never touches the bus, the PC, the interrupt state or the skip
+ * state. Anything else is left to the interpreter.
+ */
+class TR3200Jit {
+public:
+
+    typedef void (*BlockFn)(DWord* r); /// Translated block. Gets the registers
+
+    /**
+     * A translated block (or the mark of an address that can't be
+     * translated, with code == nullptr)
+     */
+    struct Block {
+        DWord pc;       /// Address of the first instruction
+        DWord end;      /// Address after the last instruction
+        unsigned cycles; /// Cycles of all the instructions of the block
+        BlockFn code;   /// Native code
+    };
+
+    static unsigned const TABLE_SIZE = 1024;         /// Block table entries
+    static unsigned const MAX_INSTS = 32;            /// Max. instructions by block
+    static std::size_t const CODE_SIZE = 256 * 1024; /// Code buffer size
+    static std::size_t const MAX_BLOCK_CODE = 4096;  /// Max. native code by block
+    static DWord const INVALID = 0xFFFFFFFF;         /// Tag of an empty entry
+
+    TR3200Jit();
+    ~TR3200Jit();
+
+    /**
+     * Returns true if the code buffer could be allocated, and made
+     * executable
+     */
+    bool isValid() const {
+        return buffer != nullptr;
+    }
+
+    /**
+     * Table entry of an address
+     */
+    Block& Entry(DWord pc) {
+        return table[(pc >> 2) & (TABLE_SIZE - 1)];
+    }
+
+    /**
+     * Begins to emit a new block. Flushes all if the buffer is full
+     * \return False if the buffer can't be made writable. The buffer is
+     * released, so isValid() returns false
+     */
+    bool Begin();
+
+    /**
+     * Ends the block being emitted and stores it on his table entry
+     * \param pc Address of the first instruction
+     * \param end Address after the last instruction
+     * \param cycles Cycles of the block
+     * \param ninsts Nº of translated instructions. If is 0, marks the
+     * address as not translatable
+     * \return The table entry. Without code, if the buffer can't be made
+     * executable again
+     */
+    Block& End(DWord pc, DWord end, unsigned cycles, unsigned ninsts);
+
+    /**
+     * Drops the blocks that have code in a range of addresses
+     */
+    void Invalidate(DWord addr, std::size_t size);
+
+    /**
+     * Drops all the blocks
+     */
+    void Flush();
+
+    /**
+     * Nº of blocks that have code in a page
+     */
+    std::size_t Blocks(DWord page) const {
+        return page_slots[page].size();
+    }
+
+    /**
+     * Bytes used of the code buffer
+     */
+    std::size_t Used() const {
+        return used;
+    }
+
+    /**
+     * Drops the code emitted after a point
+     * \param mark Value of Used() at that point
+     */
+    void Rewind(std::size_t mark) {
+        used = mark;
+    }
+
+    // Emitter. Registers are x86 register numbers (EAX=0, ECX=1 ...) and
+    // idx are TR3200 register indexes
+
+    void Emit(Byte b);
+    void Emit(Byte b0, Byte b1);
+    void Emit(Byte b0, Byte b1, Byte b2);
+    void Emit32(DWord v);
+
+    void LoadReg(Byte reg, unsigned idx);  /// mov reg, [rdi + idx*4]
+    void StoreReg(Byte reg, unsigned idx); /// mov [rdi + idx*4], reg
+    void LoadImm(Byte reg, DWord v);       /// mov reg, imm32
+
+    static Byte const EAX = 0;
+    static Byte const ECX = 1;
+    static Byte const EDX = 2;
+    static Byte const ESI = 6;
+
+private:
+
+    TR3200Jit(const TR3200Jit&);            // Not copyable
+    TR3200Jit& operator=(const TR3200Jit&);
+
+    /**
+     * Adds a table entry to the lists of the pages of his block
+     */
+    void Link(Word slot);
+
+    /**
+     * Removes a table entry from the lists of the pages of his block
+     */
+    void Unlink(Word slot);
+
+    /**
+     * Makes the code buffer writable (RW) or executable (RX). If it fails,
+     * the buffer is released
+     * \param write True to make it writable
+     * \return False if fails
+     */
+    bool Protect(bool write);
+
+    /**
+     * Releases the code buffer and drops all the blocks
+     */
+    void Release();
+
+    std::vector<Block> table;     /// Direct mapped table of blocks
+    std::vector<std::vector<Word>> page_slots; /// Table entries of the blocks of each page
+    Byte* buffer;     /// Code buffer
+    std::size_t used; /// Used bytes of the buffer
+    std::size_t start; /// Begin of the block being emitted
+    bool writable;     /// Buffer is RW (emitting), or else RX
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TR3200_JIT_HPP_
@@ -9,6 +9,111 @@
 #ifndef __TR3200_OPCODES_HPP_
 #define __TR3200_OPCODES_HPP_ 1
 
+// Description of each instruction ********************************************
+//
+// Each instruction is described only here. The OpCode enums, the cycle and
+// dispatch tables of the interpreter, the predecoder and the disassembler are
+// generated from this lists (see tr3200_isa.hpp).
+//
+// X(name, opcode, cycles, operands, flags, mnemonic)
+//   cycles   : Base cycles, without the big literal fetch
+//   operands : OPS_xxx kind of operands. Says how are used Rd, Rs and Rn
+//   flags    : ISA_xxx flags (branch, memory access, stack, etc)
+
+/**
+ * 3 parameters instructions
+ */
+#define TR3200_P3_INSTRUCTIONS(X) \
+    X(AND,     0x80,  3, OPS_RD_RS_RN,  0,           "AND")     \
+    X(OR,      0x81,  3, OPS_RD_RS_RN,  0,           "OR")      \
+    X(XOR,     0x82,  3, OPS_RD_RS_RN,  0,           "XOR")     \
+    X(BITC,    0x83,  3, OPS_RD_RS_RN,  0,           "BITC")    \
+    X(ADD,     0x84,  3, OPS_RD_RS_RN,  0,           "ADD")     \
+    X(ADDC,    0x85,  3, OPS_RD_RS_RN,  ISA_CARRY,   "ADDC")    \
+    X(SUB,     0x86,  3, OPS_RD_RS_RN,  0,           "SUB")     \
+    X(SUBB,    0x87,  3, OPS_RD_RS_RN,  ISA_CARRY,   "SUBB")    \
+    X(RSB,     0x88,  3, OPS_RD_RS_RN,  0,           "RSB")     \
+    X(RSBB,    0x89,  3, OPS_RD_RS_RN,  ISA_CARRY,   "RSBB")    \
+    X(LLS,     0x8A,  3, OPS_RD_RS_RN,  0,           "LLS")     \
+    X(RLS,     0x8B,  3, OPS_RD_RS_RN,  0,           "RLS")     \
+    X(ARS,     0x8C,  3, OPS_RD_RS_RN,  0,           "ARS")     \
+    X(ROTL,    0x8D,  3, OPS_RD_RS_RN,  0,           "ROTL")    \
+    X(ROTR,    0x8E,  3, OPS_RD_RS_RN,  0,           "ROTR")    \
+    X(MUL,     0x8F, 20, OPS_RD_RS_RN,  0,           "MUL")     \
+    X(SMUL,    0x90, 30, OPS_RD_RS_RN,  0,           "SMUL")    \
+    X(DIV,     0x91, 25, OPS_RD_RS_RN,  0,           "DIV")     \
+    X(SDIV,    0x92, 35, OPS_RD_RS_RN,  0,           "SDIV")    \
+    X(LOAD,    0x93,  3, OPS_LOAD_RS_RN,  ISA_READ,  "LOAD")    \
+    X(LOADW,   0x94,  3, OPS_LOAD_RS_RN,  ISA_READ,  "LOADW")   \
+    X(LOADB,   0x95,  3, OPS_LOAD_RS_RN,  ISA_READ,  "LOADB")   \
+    X(STORE,   0x96,  3, OPS_STORE_RS_RN, ISA_WRITE, "STORE")   \
+    X(STOREW,  0x97,  3, OPS_STORE_RS_RN, ISA_WRITE, "STOREW")  \
+    X(STOREB,  0x98,  3, OPS_STORE_RS_RN, ISA_WRITE, "STOREB")
+
+/**
+ * 2 parameters instructions
+ */
+#define TR3200_P2_INSTRUCTIONS(X) \
+    X(MOV,     0x40,  3, OPS_RD_RN,     0,           "MOV")     \
+    X(SWP,     0x41,  3, OPS_RD_RN,     0,           "SWP")     \
+    X(NOT,     0x42,  3, OPS_RD_RN,     0,           "NOT")     \
+    X(SIGXB,   0x43,  3, OPS_RD_RN,     0,           "SIGXB")   \
+    X(SIGXW,   0x44,  3, OPS_RD_RN,     0,           "SIGXW")   \
+    X(LOAD2,   0x45,  3, OPS_LOAD_RN,   ISA_READ,    "LOAD")    \
+    X(LOADW2,  0x46,  3, OPS_LOAD_RN,   ISA_READ,    "LOADW")   \
+    X(LOADB2,  0x47,  3, OPS_LOAD_RN,   ISA_READ,    "LOADB")   \
+    X(STORE2,  0x48,  3, OPS_STORE_RN,  ISA_WRITE,   "STORE")   \
+    X(STOREW2, 0x49,  3, OPS_STORE_RN,  ISA_WRITE,   "STOREW")  \
+    X(STOREB2, 0x4A,  3, OPS_STORE_RN,  ISA_WRITE,   "STOREB")  \
+    X(JMP2,    0x4B,  3, OPS_RD_OFFSET, ISA_JUMP,    "JMP")     \
+    X(CALL2,   0x4C,  4, OPS_RD_OFFSET, ISA_JUMP | ISA_STACK, "CALL") \
+    X(IFEQ,    0x70,  3, OPS_RD_RN,     ISA_BRANCH,  "IFEQ")    \
+    X(IFNEQ,   0x71,  3, OPS_RD_RN,     ISA_BRANCH,  "IFNEQ")   \
+    X(IFL,     0x72,  3, OPS_RD_RN,     ISA_BRANCH,  "IFL")     \
+    X(IFSL,    0x73,  3, OPS_RD_RN,     ISA_BRANCH,  "IFSL")    \
+    X(IFLE,    0x74,  3, OPS_RD_RN,     ISA_BRANCH,  "IFLE")    \
+    X(IFSLE,   0x75,  3, OPS_RD_RN,     ISA_BRANCH,  "IFSLE")   \
+    X(IFG,     0x76,  3, OPS_RD_RN,     ISA_BRANCH,  "IFG")     \
+    X(IFSG,    0x77,  3, OPS_RD_RN,     ISA_BRANCH,  "IFSG")    \
+    X(IFGE,    0x78,  3, OPS_RD_RN,     ISA_BRANCH,  "IFGE")    \
+    X(IFSGE,   0x79,  3, OPS_RD_RN,     ISA_BRANCH,  "IFSGE")   \
+    X(IFBITS,  0x7A,  3, OPS_RD_RN,     ISA_BRANCH,  "IFBITS")  \
+    X(IFCLEAR, 0x7B,  3, OPS_RD_RN,     ISA_BRANCH,  "IFCLEAR")
+
+/**
+ * 1 parameter instructions
+ */
+#define TR3200_P1_INSTRUCTIONS(X) \
+    X(XCHGB,   0x20,  3, OPS_REG,       0,           "XCHGB")   \
+    X(XCHGW,   0x21,  3, OPS_REG,       0,           "XCHGW")   \
+    X(GETPC,   0x22,  3, OPS_REG,       0,           "GETPC")   \
+    X(POP,     0x23,  3, OPS_REG,       ISA_STACK,   "POP")     \
+    X(PUSH,    0x24,  3, OPS_RN,        ISA_STACK,   "PUSH")    \
+    X(JMP,     0x25,  3, OPS_ADDRESS,   ISA_JUMP,    "JMP")     \
+    X(CALL,    0x26,  4, OPS_ADDRESS,   ISA_JUMP | ISA_STACK, "CALL") \
+    X(RJMP,    0x27,  3, OPS_PC_OFFSET, ISA_JUMP,    "JMP")     \
+    X(RCALL,   0x28,  4, OPS_PC_OFFSET, ISA_JUMP | ISA_STACK, "CALL") \
+    X(INT,     0x29,  6, OPS_INT,       ISA_JUMP | ISA_STACK, "INT")
+
+/**
+ * Instructions without parameters
+ */
+#define TR3200_NP_INSTRUCTIONS(X) \
+    X(SLEEP,   0x00,  1, OPS_NONE,      0,           "SLEEP")   \
+    X(RET,     0x01,  4, OPS_NONE,      ISA_JUMP | ISA_STACK, "RET") \
+    X(RFI,     0x02,  6, OPS_NONE,      ISA_JUMP | ISA_STACK, "RFI")
+
+/**
+ * All the instructions
+ */
+#define TR3200_INSTRUCTIONS(X) \
+    TR3200_P3_INSTRUCTIONS(X) \
+    TR3200_P2_INSTRUCTIONS(X) \
+    TR3200_P1_INSTRUCTIONS(X) \
+    TR3200_NP_INSTRUCTIONS(X)
+
+#define TR3200_OPCODE_ENUM(name, opcode, ...) name = opcode,
+
 namespace trillek {
 namespace computer {
 
@@ -18,36 +123,7 @@ namespace computer {
  * 3 parameters OpCodes
  */
 enum P3_OPCODE {
-    AND  = 0x80,
-    OR   = 0x81,
-    XOR  = 0x82,
-    BITC = 0x83,
-
-    ADD  = 0x84,
-    ADDC = 0x85,
-    SUB  = 0x86,
-    SUBB = 0x87,
-    RSB  = 0x88,
-    RSBB = 0x89,
-
-    LLS  = 0x8A,
-    RLS  = 0x8B,
-    ARS  = 0x8C,
-    ROTL = 0x8D,
-    ROTR = 0x8E,
-
-    MUL  = 0x8F,
-    SMUL = 0x90,
-    DIV  = 0x91,
-    SDIV = 0x92,
-
-    LOAD  = 0x93,
-    LOADW = 0x94,
-    LOADB = 0x95,
-
-    STORE  = 0x96,
-    STOREW = 0x97,
-    STOREB = 0x98,
+    TR3200_P3_INSTRUCTIONS(TR3200_OPCODE_ENUM)
 };
 
 // 2 Parameters OpCodes *******************************************************
@@ -56,41 +132,7 @@ enum P3_OPCODE {
  * 2 parameter OpCodes
  */
 enum P2_OPCODE {
-    MOV = 0x40,
-    SWP = 0x41,
-
-    NOT = 0x42,
-
-    SIGXB = 0x43,
-    SIGXW = 0x44,
-
-    LOAD2  = 0x45,
-    LOADW2 = 0x46,
-    LOADB2 = 0x47,
-
-    STORE2  = 0x48,
-    STOREW2 = 0x49,
-    STOREB2 = 0x4A,
-
-    JMP2  = 0x4B,
-    CALL2 = 0x4C,
-
-    IFEQ  = 0x70,
-    IFNEQ = 0x71,
-
-    IFL   = 0x72,
-    IFSL  = 0x73,
-    IFLE  = 0x74,
-    IFSLE = 0x75,
-
-    IFG   = 0x76,
-    IFSG  = 0x77,
-    IFGE  = 0x78,
-    IFSGE = 0x79,
-
-    IFBITS  = 0x7A,
-    IFCLEAR = 0x7B,
-
+    TR3200_P2_INSTRUCTIONS(TR3200_OPCODE_ENUM)
 };
 
 // 1 Parameter OpCodes ********************************************************
@@ -99,22 +141,7 @@ enum P2_OPCODE {
  * 1 Parameter OpCodes
  */
 enum P1_OPCODE {
-
-    XCHGB = 0x20,
-    XCHGW = 0x21,
-
-    GETPC = 0x22,
-
-    POP  = 0x23,
-    PUSH = 0x24,
-
-    JMP  = 0x25,
-    CALL = 0x26,
-
-    RJMP  = 0x27,
-    RCALL = 0x28,
-
-    INT = 0x29,
+    TR3200_P1_INSTRUCTIONS(TR3200_OPCODE_ENUM)
 };
 
 // 0 Parameters OpCodes ********************************************************
@@ -123,13 +150,12 @@ enum P1_OPCODE {
  * 0 Paramaters OpCodes
  */
 enum NP_OPCODE {
-    SLEEP = 0x00,
-
-    RET = 0x01,
-    RFI = 0x02,
+    TR3200_NP_INSTRUCTIONS(TR3200_OPCODE_ENUM)
 };
 
 } // End of namespace computer
 } // End of namespace trillek
 
+#undef TR3200_OPCODE_ENUM
+
 #endif // __TR3200_OPCODES_HPP_
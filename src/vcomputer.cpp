@@ -12,9 +12,17 @@
 #include "config.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cassert>
 
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace trillek {
 namespace computer {
 
@@ -70,12 +78,24 @@ static void my_free(void *block) {
 
 
 
-VComputer::VComputer (std::size_t ram_size ) :
-    is_on(false), ram(nullptr), rom(nullptr), ram_size(ram_size), rom_size(0), breaking(false), recover_break(false) {
+VComputer::VComputer (std::size_t ram_size ) : VComputer(ram_size, nullptr) {
+}
+
+VComputer::VComputer (std::size_t ram_size, Byte* ext_ram) :
+    is_on(false), ram(ext_ram), rom(nullptr), ram_size(ram_size), rom_size(0),
+    ram_backing(RAM_EXTERNAL), clear_ram(true), dirty_tracking(false), profiling(false),
+    breaking(false), last_watch(0), watch_break(false), last_break(0), skip_break(false) {
 
-    ram = my_malloc(ram_size);  //new byte_t[ram_size];
-    assert(ram != nullptr);
-    std::fill_n(ram, ram_size, 0);
+    if (ram == nullptr) {
+        ram = my_malloc(ram_size);  //new byte_t[ram_size];
+        assert(ram != nullptr);
+        ram_backing = RAM_HEAP;
+        std::fill_n(ram, ram_size, 0);
+    }
+
+    std::fill_n(page_handler, BusPages, 0);
+    std::fill_n(page_flags, BusPages, 0);
+    BusChanged();
 
     // Add timers addresses
     Range pit_range(0x11E000, 0x11E010);
@@ -98,12 +118,27 @@ VComputer::VComputer (std::size_t ram_size ) :
     AddAddrListener(nvram_range, &nvram);
 }
 
-VComputer::~VComputer () {
-    if (ram != nullptr) {
-        my_free((void*)ram);
-        //delete[] ram;
+VComputer::VComputer (std::shared_ptr<const RamImage> image) :
+    VComputer(image ? image->Size() : 128 * 1024,
+              image ? image->MapPrivate() : nullptr) {
+
+    if (!image) {
+        return; // Not image, so is a plain computer with the default RAM
     }
 
+    if (ram_backing == RAM_EXTERNAL) {
+        ram_backing = RAM_IMAGE;
+        ram_image = image;
+    } else if (image->isValid()) {
+        // Can't be mapped, so the RAM gets a copy
+        std::memcpy(ram, image->Data(), ram_size);
+    }
+    clear_ram = false;
+}
+
+VComputer::~VComputer () {
+    FreeRAM();
+
     // Drops plugged devices
     for (unsigned i = 0; i < MAX_N_DEVICES; i++) {
         this->RmDevice(i);
@@ -113,6 +148,7 @@ VComputer::~VComputer () {
 void VComputer::SetCPU (std::unique_ptr<ICPU> cpu) {
     this->cpu = std::move(cpu);
     this->cpu->SetVComputer(this);
+    FlushCodeCache();
 }
 
 std::unique_ptr<ICPU> VComputer::RmCPU () {
@@ -130,7 +166,6 @@ bool VComputer::AddDevice (unsigned slot, std::shared_ptr<Device> dev) {
     }
 
     auto enumblk = new EnumAndCtrlBlk( slot, dev.get() );
-    // TODO Check if listernes std::map would do a double free when a device is removed
     std::get<2>(devices[slot]) = this->AddAddrListener(enumblk->GetRange(), enumblk);
     if (std::get<2>(devices[slot]) != -1) {
         std::get<0>(devices[slot]) = dev;
@@ -158,8 +193,8 @@ void VComputer::RmDevice (unsigned slot) {
     if ( slot < MAX_N_DEVICES && std::get<0>(devices[slot]) ) {
         std::get<0>(devices[slot])->SetVComputer(nullptr);
         std::get<0>(devices[slot]).reset(); // Cleans the slot
+        this->RmAddrListener(std::get<2>(devices[slot]));
         delete std::get<1>(devices[slot]);
-        // TODO RmDevice should remove the AddrListener
         std::get<1>(devices[slot]) = nullptr;
         std::get<2>(devices[slot]) = -1;
     }
@@ -191,8 +226,148 @@ void VComputer::SetROM (const Byte* rom, std::size_t rom_size) {
 
     this->rom      = rom;
     this->rom_size = (rom_size > MAX_ROM_SIZE) ? MAX_ROM_SIZE : rom_size;
+    FlushCodeCache();
 }
 
+void VComputer::FreeRAM () {
+    if (ram == nullptr) {
+        return;
+    }
+
+    switch (ram_backing) {
+    case RAM_IMAGE:
+        ram_image->Unmap(ram);
+        ram_image.reset();
+        break;
+
+    case RAM_FILE:
+#if !defined(_WIN32)
+        munmap(ram, ram_size);
+#endif
+        break;
+
+    case RAM_EXTERNAL:
+        break; // Owned by a VComputerFleet
+
+    default:
+        my_free((void*)ram);
+        break;
+    }
+    ram = nullptr;
+    ram_backing = RAM_HEAP;
+}
+
+std::shared_ptr<const RamImage> VComputer::SnapshotRAM () const {
+    auto image = std::make_shared<const RamImage>(ram, ram_size);
+    if (! image->isValid()) {
+        return nullptr;
+    }
+    return image;
+}
+
+bool VComputer::LoadRAMImage (std::shared_ptr<const RamImage> image) {
+    if (!image) { // SnapshotRAM could fail, so CloneFrom can give us nullptr
+        return false;
+    }
+    if (image->Size() != ram_size) {
+        return false;
+    }
+
+    Byte* view = image->MapPrivate();
+    if (view == nullptr) {
+        return false;
+    }
+
+    FreeRAM();
+    ram = view;
+    ram_backing = RAM_IMAGE;
+    ram_image = image;
+    clear_ram = false;
+    MarkDirty(0, ram_size);
+    FlushCodeCache();
+    return true;
+}
+
+bool VComputer::MapRAMFile (const std::string& filename) {
+#if !defined(_WIN32)
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((std::size_t)st.st_size < ram_size && ftruncate(fd, ram_size) != 0) ) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(nullptr, ram_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps a reference to the file
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    FreeRAM();
+    ram = (Byte*)p;
+    ram_backing = RAM_FILE;
+    clear_ram = false;
+    MarkDirty(0, ram_size);
+    FlushCodeCache();
+    return true;
+#else
+    return false;
+#endif
+} // MapRAMFile
+
+bool VComputer::SyncRAMFile (bool wait) {
+#if !defined(_WIN32)
+    if (ram_backing == RAM_FILE) {
+        return msync(ram, ram_size, wait ? MS_SYNC : MS_ASYNC) == 0;
+    }
+#endif
+    return false;
+}
+
+bool VComputer::CloneFrom (const VComputer& other,
+                           std::shared_ptr<const RamImage> image) {
+    if (ram_size != other.ram_size) {
+        return false;
+    }
+
+    if (!image) {
+        image = other.SnapshotRAM();
+    }
+    if (! this->LoadRAMImage(image) ) {
+        return false;
+    }
+
+    if (other.rom != nullptr) {
+        this->SetROM(other.rom, other.rom_size);
+    }
+
+    if (cpu && other.cpu) {
+        // We not know the size of the CPU state, so we try with bigger
+        // buffers until GetState can write it
+        std::vector<Byte> state;
+        std::size_t size = 0;
+        for (std::size_t cap = 1024; size == 0 && cap <= 64*1024; cap *= 2) {
+            state.resize(cap);
+            size = cap;
+            other.cpu->GetState(state.data(), size);
+        }
+        if (size == 0 || ! cpu->SetState(state.data(), size) ) {
+            return false;
+        }
+    }
+
+    is_on = other.is_on && cpu;
+    breaking    = false;
+    watch_break = false;
+    skip_break  = false;
+    return true;
+} // CloneFrom
+
 void VComputer::Reset() {
     if (cpu) {
         cpu->Reset();
@@ -212,13 +387,16 @@ void VComputer::Reset() {
 
 
     // Cleat Break status
-    breaking = false;
+    breaking    = false;
+    watch_break = false;
 } // Reset
 
 void VComputer::On() {
     // Powering it wihtout cpu ?
     if (cpu && !is_on) {
-        std::fill_n(ram, ram_size, 0);
+        if (clear_ram) {
+            std::fill_n(ram, ram_size, 0);
+        }
         is_on = true;
         this->Reset(); // When we power on, we get a Reset!
     }
@@ -251,13 +429,15 @@ unsigned VComputer::Update( const double delta) {
 
 unsigned VComputer::Step( const double delta) {
     if (is_on) {
+        if (breaking) {
+            return 0; // Halted by a breakpoint or watchpoint
+        }
+
         unsigned cpu_ticks = cpu->Step();
 
-        #ifdef BRKPOINTS
-        if (breaking) {
+        if (breaking && !watch_break) {
             return 0; // We not executed yet the instruction!
         }
-        #endif
 
         const unsigned base_ticks = cpu_ticks * ( BaseClock / cpu->Clock() );
         const unsigned dev_ticks  = (base_ticks / 10); // Devices clock is at 100 KHz
@@ -309,55 +489,101 @@ unsigned VComputer::Step( const double delta) {
 
 void VComputer::Tick( unsigned n, const double delta) {
     assert(n > 0);
-    if (is_on) {
-        unsigned dev_ticks = n / 10; // Devices clock is at 100 KHz
-        unsigned cpu_ticks = n / ( BaseClock / cpu->Clock() );
+    if (!is_on) {
+        return;
+    }
 
-        cpu->Tick(cpu_ticks);
-        // TODO ICPU.Tick should return the number of cycles that executed,
-        // so we can accrutraly execute the apropaite number of Device
-        // cycles if a breakpoint happens
-        pit.Tick(dev_ticks, delta);
+    // A sleeping CPU does nothing until an interrupt, so we jump straight
+    // to the next device event. The CPU wakes up on time, and runs the
+    // rest of the ticks. The CPU cycles of each slice are taken from the
+    // ticks done, so the slices not lose the remainder of the CPU divisor
+    const unsigned total = n;
+    const unsigned divisor = BaseClock / cpu->Clock();
+    unsigned done = 0;
+    while ( !breaking && cpu->isSleeping() ) {
+        const unsigned next = NextEvent();
+        if (next >= n / 10) {
+            break; // Nothing happens before the end
+        }
+        const unsigned slice = std::max(next, 1u) * 10;
+        TickSlice(slice, (done + slice) / divisor - done / divisor,
+                  delta * slice / total);
+        done += slice;
+        n -= slice;
+    }
+    TickSlice(n, total / divisor - done / divisor, delta * n / total);
+} // Tick
 
-        Word msg;
-        bool interrupted = pit.DoesInterrupt(msg); // Highest priority
-                                                   // interrupt
-        if (interrupted) {
-            if ( cpu->SendInterrupt(msg) ) {
-                // Send the interrupt to the CPU
-                pit.IACK();
-            }
+unsigned VComputer::NextEvent() const {
+    unsigned next = pit.NextEvent();
+    for (std::size_t i = 0; i < MAX_N_DEVICES; i++) {
+        if ( std::get<0>(devices[i]) ) {
+            next = std::min(next, std::get<0>(devices[i])->NextEvent());
         }
+    }
+    return next;
+} // NextEvent
 
-        for (std::size_t i = 0; i < MAX_N_DEVICES; i++) {
-            if ( !std::get<0>(devices[i]) ) {
-                continue; // Slot without device
-            }
+void VComputer::TickSlice( unsigned n, unsigned cpu_ticks, const double delta) {
+    unsigned dev_ticks = n / 10; // Devices clock is at 100 KHz
 
-            // Does the sync job
-            if ( std::get<0>(devices[i])->IsSyncDev() ) {
-                std::get<0>(devices[i])->Tick(dev_ticks, delta);
-            }
+    if (!breaking) {
+        const unsigned done = cpu->Tick(cpu_ticks);
+        if (done < cpu_ticks) {
+            // A breakpoint happened. Devices only run the same time
+            dev_ticks = done * ( BaseClock / cpu->Clock() ) / 10;
+        }
+    }
+    pit.Tick(dev_ticks, delta);
+
+    Word msg;
+    bool interrupted = pit.DoesInterrupt(msg); // Highest priority
+                                               // interrupt
+    if (interrupted) {
+        if ( cpu->SendInterrupt(msg) ) {
+            // Send the interrupt to the CPU
+            pit.IACK();
+        }
+    }
 
-            // Try to get the highest priority interrupt
-            if ( !interrupted && std::get<0>(devices[i])->DoesInterrupt(msg) ) {
-                interrupted = true;
-                if ( cpu->SendInterrupt(msg) ) {
-                    // Send the interrupt to the CPU
-                    std::get<0>(devices[i])->IACK(); // Informs to the device
-                                                     // that his interrupt
-                                                     // has been accepted by
-                                                     // the CPU
-                }
+    for (std::size_t i = 0; i < MAX_N_DEVICES; i++) {
+        if ( !std::get<0>(devices[i]) ) {
+            continue; // Slot without device
+        }
+
+        // Does the sync job
+        if ( std::get<0>(devices[i])->IsSyncDev() ) {
+            std::get<0>(devices[i])->Tick(dev_ticks, delta);
+        }
+
+        // Try to get the highest priority interrupt
+        if ( !interrupted && std::get<0>(devices[i])->DoesInterrupt(msg) ) {
+            interrupted = true;
+            if ( cpu->SendInterrupt(msg) ) {
+                // Send the interrupt to the CPU
+                std::get<0>(devices[i])->IACK(); // Informs to the device
+                                                 // that his interrupt
+                                                 // has been accepted by
+                                                 // the CPU
             }
         }
     }
-} // Tick
+} // TickSlice
 
 int32_t VComputer::AddAddrListener (const Range& range, AddrListener* listener) {
     assert(listener != nullptr);
+    if (listeners.size() >= MAX_ADDR_LISTENERS) {
+        return -1;
+    }
+
     if (listeners.insert( std::make_pair(range, listener) ).second ) {
         // Correct insertion
+        if (! RebuildAddrDecoder() ) {
+            // The address decoder can't index more shared pages
+            listeners.erase(range);
+            RebuildAddrDecoder();
+            return -1;
+        }
         return range.start;
     }
     return -1;
@@ -366,10 +592,491 @@ int32_t VComputer::AddAddrListener (const Range& range, AddrListener* listener)
 bool VComputer::RmAddrListener (int32_t id) {
     Range r(id);
 
-    return listeners.erase(r) >= 1;
+    if (listeners.erase(r) >= 1) {
+        RebuildAddrDecoder();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Access to an AddrListener with the apropiated access width
+ */
+static inline Byte ListenerRead (AddrListener* listener, DWord addr, Byte) {
+    return listener->ReadB(addr);
+}
+
+static inline Word ListenerRead (AddrListener* listener, DWord addr, Word) {
+    return listener->ReadW(addr);
+}
+
+static inline DWord ListenerRead (AddrListener* listener, DWord addr, DWord) {
+    return listener->ReadDW(addr);
+}
+
+static inline void ListenerWrite (AddrListener* listener, DWord addr, Byte val) {
+    listener->WriteB(addr, val);
+}
 
+static inline void ListenerWrite (AddrListener* listener, DWord addr, Word val) {
+    listener->WriteW(addr, val);
 }
 
+static inline void ListenerWrite (AddrListener* listener, DWord addr, DWord val) {
+    listener->WriteDW(addr, val);
+}
+
+template <typename T>
+T VComputer::BusRead (DWord addr, bool fetch) const {
+    if (profiling) {
+        PageCounters& counters = profile_pages[addr >> BusPageShift];
+        if (fetch) {
+            counters.fetches++;
+        } else {
+            counters.reads++;
+        }
+    }
+
+    if ( addr + sizeof(T) <= 0x1000000 && (PageFlags(addr, sizeof(T)) & PAGE_WATCH_R) ) {
+        CheckWatchPoint(addr, sizeof(T), WATCH_READ);
+    }
+    return BusLoad<T>(addr);
+} // BusRead
+
+template <typename T>
+T VComputer::BusLoad (DWord addr) const {
+    T val = 0;
+    if ( addr + sizeof(T) <= ram_size ) {
+        std::memcpy(&val, ram + addr, sizeof(T));
+        return val;
+    }
+
+    const DWord rom_addr = addr - 0x100000;
+    if ( addr >= 0x100000 && rom_addr + sizeof(T) <= rom_size ) {
+        std::memcpy(&val, rom + rom_addr, sizeof(T));
+        return val;
+    }
+
+    const bool in_rom = (addr & 0xFF0000) == 0x100000;
+    if ( sizeof(T) > 1 && (addr < ram_size || in_rom) ) {
+        // Straddles the end of RAM or ROM, so we read byte a byte
+        for (unsigned i = 0; i < sizeof(T); i++) {
+            val |= ( (T)BusLoad<Byte>((addr + i) & 0x00FFFFFF) ) << (i * 8);
+        }
+        return val;
+    }
+
+    if (in_rom) {
+        return 0; // Outside of the ROM chip
+    }
+
+    AddrListener* listener = FindListener(addr);
+    if ( listener != nullptr ) {
+        if (profiling) {
+            profile_mmio[listener].first++;
+        }
+        return ListenerRead(listener, addr, T() );
+    }
+    return 0;
+} // BusLoad
+
+template <typename T>
+void VComputer::BusWrite (DWord addr, T val) {
+    if (profiling) {
+        profile_pages[addr >> BusPageShift].writes++;
+    }
+
+    if ( addr + sizeof(T) <= 0x1000000 && (PageFlags(addr, sizeof(T)) & PAGE_WATCH_W) ) {
+        CheckWatchPoint(addr, sizeof(T), WATCH_WRITE);
+    }
+    BusStore<T>(addr, val);
+} // BusWrite
+
+template <typename T>
+void VComputer::BusStore (DWord addr, T val) {
+    if ( sizeof(T) > 1 && addr < ram_size && addr + sizeof(T) > ram_size ) {
+        // Straddles the end of RAM, so we write byte a byte
+        for (unsigned i = 0; i < sizeof(T); i++) {
+            BusStore<Byte>(addr + i, (Byte)(val >> (i * 8)) );
+        }
+        return;
+    }
+
+    if ( addr < ram_size ) {
+        std::memcpy(ram + addr, &val, sizeof(T));
+        MarkDirty(addr, sizeof(T));
+        if ( cpu && (PageFlags(addr, sizeof(T)) & PAGE_CODE) ) {
+            cpu->InvalidateCode(addr, sizeof(T));
+        }
+    }
+
+    AddrListener* listener = FindListener(addr);
+    if ( listener != nullptr ) {
+        if (profiling) {
+            profile_mmio[listener].second++;
+        }
+        ListenerWrite(listener, addr, val);
+    }
+} // BusStore
+
+Byte VComputer::ReadSlow (DWord addr, Byte, bool fetch) const {
+    return BusRead<Byte>(addr, fetch);
+}
+
+Word VComputer::ReadSlow (DWord addr, Word, bool fetch) const {
+    return BusRead<Word>(addr, fetch);
+}
+
+DWord VComputer::ReadSlow (DWord addr, DWord, bool fetch) const {
+    return BusRead<DWord>(addr, fetch);
+}
+
+void VComputer::WriteSlow (DWord addr, Byte val) {
+    BusWrite<Byte>(addr, val);
+}
+
+void VComputer::WriteSlow (DWord addr, Word val) {
+    BusWrite<Word>(addr, val);
+}
+
+void VComputer::WriteSlow (DWord addr, DWord val) {
+    BusWrite<DWord>(addr, val);
+}
+
+void VComputer::DmaRead (DWord addr, Byte* dst, std::size_t size) const {
+    while (size > 0) {
+        addr &= 0x00FFFFFF;
+        // We copy page a page, so each chunk is only RAM, ROM or listeners
+        const std::size_t len = std::min(size, BusPageSize - (addr & (BusPageSize - 1)) );
+        if ( page_flags[addr >> BusPageShift] & PAGE_WATCH_R ) {
+            CheckWatchPoint(addr, len, WATCH_READ);
+        }
+        if ( profiling ) {
+            profile_pages[addr >> BusPageShift].reads++; // A read by chunk
+        }
+
+        const DWord rom_addr = addr - 0x100000;
+        if ( addr + len <= ram_size || (addr >= 0x100000 && rom_addr + len <= rom_size) ) {
+            std::memcpy(dst, (addr < ram_size) ? ram + addr : rom + rom_addr, len);
+        } else {
+            for (std::size_t i = 0; i < len; i++) {
+                dst[i] = BusLoad<Byte>(addr + i);
+            }
+        }
+        addr += len;
+        dst  += len;
+        size -= len;
+    }
+} // DmaRead
+
+void VComputer::DmaWrite (DWord addr, const Byte* src, std::size_t size) {
+    while (size > 0) {
+        addr &= 0x00FFFFFF;
+        const std::size_t len = std::min(size, BusPageSize - (addr & (BusPageSize - 1)) );
+        if ( page_flags[addr >> BusPageShift] & PAGE_WATCH_W ) {
+            CheckWatchPoint(addr, len, WATCH_WRITE);
+        }
+        if ( profiling ) {
+            profile_pages[addr >> BusPageShift].writes++; // A write by chunk
+        }
+
+        if ( addr + len <= ram_size && (page_flags[addr >> BusPageShift] & PAGE_MMIO) == 0 ) {
+            std::memcpy(ram + addr, src, len);
+            if ( page_flags[addr >> BusPageShift] & PAGE_DIRTY_TRACK ) {
+                MarkDirty(addr, len);
+            }
+            if ( cpu && (page_flags[addr >> BusPageShift] & PAGE_CODE) ) {
+                cpu->InvalidateCode(addr, len);
+            }
+        } else {
+            for (std::size_t i = 0; i < len; i++) {
+                BusStore<Byte>(addr + i, src[i]);
+            }
+        }
+        addr += len;
+        src  += len;
+        size -= len;
+    }
+} // DmaWrite
+
+bool VComputer::WatchCode (DWord addr, std::size_t size) {
+    addr &= 0x00FFFFFF;
+    if ( addr + size > 0x1000000 || (PageFlags(addr, size) & PAGE_TRAP_READ) ) {
+        return false;
+    }
+
+    if ( addr + size <= ram_size ) {
+        if ( (PageFlags(addr, size) & PAGE_CODE) == 0 ) {
+            BusChanged(); // Writes to these pages must be trapped
+        }
+        page_flags[addr >> BusPageShift] |= PAGE_CODE;
+        page_flags[(addr + size - 1) >> BusPageShift] |= PAGE_CODE;
+        return true;
+    }
+
+    // ROM never changes
+    const DWord rom_addr = addr - 0x100000;
+    return addr >= 0x100000 && rom_addr + size <= rom_size;
+}
+
+void VComputer::UnwatchCode (DWord addr, std::size_t size) {
+    addr &= 0x00FFFFFF;
+    if ( size == 0 || addr >= ram_size ) {
+        return;
+    }
+    const DWord last = (std::min<std::size_t>(addr + size, ram_size) - 1) >> BusPageShift;
+    bool changed = false;
+    for (DWord page = addr >> BusPageShift; page <= last; page++) {
+        changed = changed || (page_flags[page] & PAGE_CODE);
+        page_flags[page] &= ~PAGE_CODE;
+    }
+    if (changed) {
+        BusChanged(); // Writes to these pages could go straight to RAM
+    }
+}
+
+void VComputer::FlushCodeCache () {
+    for (DWord page = 0; page < BusPages; page++) {
+        page_flags[page] &= ~PAGE_CODE;
+    }
+    BusChanged(); // Called too when the RAM, ROM or page flags change
+    if (cpu) {
+        cpu->InvalidateCode(0, 0x1000000);
+    }
+}
+
+const Byte* VComputer::ReadPointer (DWord addr, std::size_t& size) const {
+    addr &= 0x00FFF000;
+    if ( page_flags[addr >> BusPageShift] & PAGE_TRAP_READ ) {
+        return nullptr;
+    }
+
+    if ( addr < ram_size ) {
+        size = std::min<std::size_t>(BusPageSize, ram_size - addr);
+        return ram + addr;
+    }
+    const DWord rom_addr = addr - 0x100000;
+    if ( addr >= 0x100000 && rom_addr < rom_size ) {
+        size = std::min<std::size_t>(BusPageSize, rom_size - rom_addr);
+        return rom + rom_addr;
+    }
+    return nullptr;
+}
+
+Byte* VComputer::WritePointer (DWord addr, std::size_t& size) {
+    addr &= 0x00FFF000;
+    if ( addr >= ram_size || (page_flags[addr >> BusPageShift] & PAGE_TRAP_WRITE) ) {
+        return nullptr;
+    }
+
+    size = std::min<std::size_t>(BusPageSize, ram_size - addr);
+    return ram + addr;
+}
+
+void VComputer::BusChanged () {
+    // Shared by all the computers, so a CPU moved to other computer never
+    // sees the same version
+    static std::atomic<unsigned> last_version(0);
+    bus_version = ++last_version;
+}
+
+void VComputer::MarkDirty (DWord addr, std::size_t size) {
+    if (! dirty_tracking) {
+        return;
+    }
+    const DWord last = (addr + size - 1) >> BusPageShift;
+    for (DWord page = addr >> BusPageShift; page <= last && page < dirty_pages.size(); page++) {
+        dirty_pages[page] = true;
+        page_flags[page] &= ~PAGE_DIRTY_TRACK; // Not need to trap more writes
+    }
+}
+
+void VComputer::SetDirtyTracking (bool enable) {
+    dirty_tracking = enable;
+    if (enable) {
+        dirty_pages.assign( (ram_size + BusPageSize - 1) >> BusPageShift, false);
+        ClearDirtyPages();
+    } else {
+        dirty_pages.clear();
+        for (DWord page = 0; page < BusPages; page++) {
+            page_flags[page] &= ~PAGE_DIRTY_TRACK;
+        }
+    }
+}
+
+bool VComputer::isDirtyPage (DWord addr) const {
+    const DWord page = addr >> BusPageShift;
+    return !dirty_tracking || (page < dirty_pages.size() && dirty_pages[page]);
+}
+
+std::vector<DWord> VComputer::GetDirtyPages () const {
+    std::vector<DWord> pages;
+    for (DWord page = 0; page < dirty_pages.size(); page++) {
+        if (dirty_pages[page]) {
+            pages.push_back(page << BusPageShift);
+        }
+    }
+    return pages;
+}
+
+void VComputer::ClearDirtyPages () {
+    for (DWord page = 0; page < dirty_pages.size(); page++) {
+        dirty_pages[page] = false;
+        page_flags[page] |= PAGE_DIRTY_TRACK;
+    }
+    BusChanged();
+}
+
+void VComputer::SetProfiling (bool enable) {
+    profiling = enable;
+    if (enable) {
+        profile_pages.resize(BusPages);
+        ClearProfile();
+    }
+
+    for (DWord page = 0; page < BusPages; page++) {
+        if (enable) {
+            page_flags[page] |= PAGE_PROFILE;
+        } else {
+            page_flags[page] &= ~PAGE_PROFILE;
+        }
+    }
+    FlushCodeCache(); // Fetches of cached code would not be counted
+}
+
+void VComputer::ClearProfile () {
+    const PageCounters zero = {0, 0, 0};
+    std::fill(profile_pages.begin(), profile_pages.end(), zero);
+    profile_mmio.clear();
+}
+
+std::vector<MMIOCounters> VComputer::GetMMIOProfile () const {
+    std::vector<MMIOCounters> counters;
+    for (const auto& l : listeners) {
+        MMIOCounters c = {l.first.start, l.first.end, 0, 0};
+        auto it = profile_mmio.find(l.second);
+        if (it != profile_mmio.end()) {
+            c.reads  = it->second.first;
+            c.writes = it->second.second;
+        }
+        counters.push_back(c);
+    }
+    return counters;
+}
+
+void VComputer::WriteProfileCSV (std::ostream& stream) const {
+    stream << "kind,start,end,reads,writes,fetches\n";
+    for (DWord page = 0; page < profile_pages.size(); page++) {
+        const PageCounters& c = profile_pages[page];
+        if (c.reads == 0 && c.writes == 0 && c.fetches == 0) {
+            continue;
+        }
+        const DWord start = page << BusPageShift;
+        stream << "page," << start << "," << (start + BusPageSize - 1) << ","
+               << c.reads << "," << c.writes << "," << c.fetches << "\n";
+    }
+
+    for (const auto& c : GetMMIOProfile()) {
+        if (c.reads == 0 && c.writes == 0) {
+            continue;
+        }
+        stream << "mmio," << c.start << "," << c.end << ","
+               << c.reads << "," << c.writes << ",0\n";
+    }
+}
+
+AddrListener* VComputer::ScanListener (DWord addr) const {
+    for (std::size_t i = 1; i < handlers.size(); i++) {
+        if (handlers[i].range.start <= addr && addr <= handlers[i].range.end) {
+            return handlers[i].listener;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Marks on a sub-page the lines that are listened by a handler
+ * \param lines Sub-page lines
+ * \param page Page number of the sub-page
+ * \param range Range of addresses listened by the handler
+ * \param slot Handler index
+ * \param shared Value used to mark lines shared with other handler
+ */
+static void MarkLines (std::array<Byte, BusLines>& lines, DWord page,
+                       const Range& range, Byte slot, Byte shared) {
+    const DWord base = page << BusPageShift;
+    for (unsigned l = 0; l < BusLines; l++) {
+        const DWord start = base | (l << BusLineShift);
+        const DWord end   = start + (1 << BusLineShift) - 1;
+        if (range.end < start || range.start > end) {
+            continue;
+        }
+        lines[l] = (lines[l] == 0) ? slot : shared;
+    }
+}
+
+bool VComputer::RebuildAddrDecoder () {
+    static_assert(MAX_ADDR_LISTENERS < BusSubPage, "Page slots are 7 bit");
+
+    std::fill_n(page_handler, BusPages, 0);
+    for (unsigned page = 0; page < BusPages; page++) {
+        page_flags[page] &= ~PAGE_MMIO;
+    }
+    sub_pages.clear();
+    handlers.clear();
+    std::fill_n(port_lines, IOPorts >> BusLineShift, 0);
+
+    BusHandler null_handler = { Range(0), nullptr }; // Slot 0 is never used
+    handlers.push_back(null_handler);
+
+    for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+        const Byte slot = handlers.size();
+        BusHandler handler = { it->first, it->second };
+        handlers.push_back(handler);
+
+        const DWord first = it->first.start >> BusPageShift;
+        const DWord last  = it->first.end   >> BusPageShift;
+        for (DWord page = first; page <= last; page++) {
+            page_flags[page] |= PAGE_MMIO;
+            Byte cur = page_handler[page];
+            if (cur == 0) {
+                // The page is only used by this listener
+                page_handler[page] = slot;
+                continue;
+            }
+
+            if ( (cur & BusSubPage) == 0 ) {
+                // Page shared with other listener. Split it in lines
+                if (sub_pages.size() >= BusMaxSubPages) {
+                    BusChanged();
+                    return false; // The index would alias other sub-page
+                }
+                std::array<Byte, BusLines> lines;
+                lines.fill(0);
+                MarkLines(lines, page, handlers[cur].range, cur, BusLineShared);
+                sub_pages.push_back(lines);
+                cur = BusSubPage | (sub_pages.size() - 1);
+                page_handler[page] = cur;
+            }
+            MarkLines(sub_pages[cur & ~BusSubPage], page, it->first, slot,
+                      BusLineShared);
+        }
+
+        // Direct table of the I/O ports (devices and his EnumAndCtrlBlk),
+        // with the same 16 byte lines of the sub-pages
+        const DWord io_end = IOPortBase + IOPorts - 1;
+        if (it->first.start <= io_end && it->first.end >= IOPortBase) {
+            const DWord start = std::max(it->first.start, IOPortBase) - IOPortBase;
+            const DWord end   = std::min(it->first.end, io_end) - IOPortBase;
+            for (DWord l = start >> BusLineShift; l <= (end >> BusLineShift); l++) {
+                port_lines[l] = (port_lines[l] == 0) ? slot : BusLineShared;
+            }
+        }
+    }
+    BusChanged();
+    return true;
+} // RebuildAddrDecoder
+
 bool VComputer::isDirtyNVRAM()	{
 	return this->nvram.isDirty();
 }
@@ -383,61 +1090,118 @@ bool VComputer::SaveNVRAM(std::ostream& stream) {
 }
 
 void VComputer::SetBreakPoint(DWord addr) {
-#ifdef BRKPOINTS
-	breakpoints.insert(addr);
-#endif
+    addr &= 0x00FFFFFF;
+    breakpoints.insert(addr);
+    page_flags[addr >> BusPageShift] |= PAGE_BREAK;
+    if (cpu) {
+        cpu->InvalidateCode(addr, 1); // Cached instruction must be flagged
+    }
 }
 
 void VComputer::RmBreakPoint(DWord addr) {
-#ifdef BRKPOINTS
-	breakpoints.erase(addr);
-#endif
+    addr &= 0x00FFFFFF;
+    if (breakpoints.erase(addr) == 0) {
+        return;
+    }
+    // Keeps the page flag if there is other breakpoint on the page
+    const DWord page  = addr >> BusPageShift;
+    const auto next = breakpoints.lower_bound(page << BusPageShift);
+    if (next == breakpoints.end() || (*next >> BusPageShift) != page) {
+        page_flags[page] &= ~PAGE_BREAK;
+    }
+    if (cpu) {
+        cpu->InvalidateCode(addr, 1);
+    }
 }
 
 void VComputer::ClearBreakPoints() {
-#ifdef BRKPOINTS
-	breakpoints.clear();
-#endif
+    for (auto addr : breakpoints) {
+        page_flags[addr >> BusPageShift] &= ~PAGE_BREAK;
+        if (cpu) {
+            cpu->InvalidateCode(addr, 1);
+        }
+    }
+    breakpoints.clear();
 }
 
-bool VComputer::isBreakPoint(DWord addr) {
-#ifdef BRKPOINTS
-	if (breakpoints.find(addr) != breakpoints.end()) {
-		last_break = addr;
-		breaking = true;
-		return true;
-	}
+bool VComputer::HitBreakPoint(DWord addr) {
+    addr &= 0x00FFFFFF;
+    if (skip_break) {
+        skip_break = false;
+        if (addr == last_break) {
+            return false; // Resuming from it
+        }
+    }
 
-	if (recover_break) {
-		// Recover temporaly removed breakpoint
-		SetBreakPoint(last_break);
-		recover_break = false;
-	}
+    last_break  = addr;
+    breaking    = true;
+    watch_break = false; // The instruction will be fetched again
+    return true;
+} // HitBreakPoint
+
+void VComputer::SetWatchPoint (DWord addr, std::size_t size, WatchMode mode) {
+    assert(size > 0);
+    addr &= 0x00FFFFFF;
+    // Accesses not wrap around the address space, so neither the watchpoints
+    const DWord end = (size > 0x1000000 - addr) ? 0x00FFFFFF : addr + size - 1;
+    WatchPoint wp = { Range(addr, end), mode };
+    watchpoints.push_back(wp);
+    RebuildWatchFlags();
+}
 
-#endif
-	return false;
-} // isBreakPoint
+void VComputer::RmWatchPoint (DWord addr) {
+    addr &= 0x00FFFFFF;
+    watchpoints.erase(std::remove_if(watchpoints.begin(), watchpoints.end(),
+                [addr] (const WatchPoint& wp) { return wp.range.start == addr; }),
+            watchpoints.end() );
+    RebuildWatchFlags();
+}
 
-/**
-* Check if the Virtual Computer is halted by a breakpoint
-* \return True if a breakpoint happened
-*/
-bool VComputer::isHalted() {
-	return breaking;
+void VComputer::ClearWatchPoints () {
+    watchpoints.clear();
+    RebuildWatchFlags();
+}
+
+void VComputer::RebuildWatchFlags () {
+    for (DWord page = 0; page < BusPages; page++) {
+        page_flags[page] &= ~(PAGE_WATCH_R | PAGE_WATCH_W);
+    }
+
+    for (const auto& wp : watchpoints) {
+        const Byte flags = ((wp.mode & WATCH_READ) ? PAGE_WATCH_R : 0) |
+                           ((wp.mode & WATCH_WRITE) ? PAGE_WATCH_W : 0);
+        const DWord last = std::min<DWord>(wp.range.end >> BusPageShift, BusPages - 1);
+        for (DWord page = wp.range.start >> BusPageShift; page <= last; page++) {
+            page_flags[page] |= flags;
+        }
+    }
+    FlushCodeCache(); // Fetches of cached code would not be checked
+}
+
+void VComputer::CheckWatchPoint (DWord addr, std::size_t size, WatchMode mode) const {
+    const DWord end = addr + size - 1;
+    for (const auto& wp : watchpoints) {
+        if ( (wp.mode & mode) && addr <= wp.range.end && wp.range.start <= end ) {
+            last_watch  = addr;
+            watch_break = true;
+            breaking    = true;
+            return;
+        }
+    }
 }
 
 /**
-* Allows to continue if a Breakpoint happened
+* Allows to continue if a Breakpoint or a WatchPoint happened
 */
 void VComputer::Resume() {
-#ifdef BRKPOINTS
 	if (breaking) {
 		breaking = false;
-		// Temporaly, we remove the last break point
-		RmBreakPoint(last_break);
-		recover_break = true;
+		if (watch_break) {
+			watch_break = false;
+			return; // The access was done, so we only need to continue
+		}
+		skip_break = true; // Executes the instruction at the breakpoint
 	}
-#endif
 }
 
 } // End of namespace computer
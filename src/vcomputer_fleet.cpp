@@ -0,0 +1,117 @@
+/**
+ * \brief       Virtual Computer fleet
+ * \file        vcomputer_fleet.cpp
+ * \copyright   LGPL v3
+ *
+ * A set of Virtual Computers allocated in a single memory arena
+ */
+
+#include "vcomputer_fleet.hpp"
+
+#include <new>
+#include <cassert>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace trillek {
+namespace computer {
+
+static const std::size_t HugePageSize = 2 * 1024 * 1024;
+
+static inline std::size_t AlignUp (std::size_t v, std::size_t align) {
+    return (v + align - 1) & ~(align - 1);
+}
+
+#if defined(__linux__) && defined(SYS_mbind)
+/**
+ * Sets the prefered NUMA node of a range of memory. It must be called
+ * before touching the memory. Failures are ignored, as is only a hint.
+ */
+static void BindToNode (void* addr, std::size_t len, int node) {
+    const int MPOL_PREFERRED = 1;
+    const unsigned bits = 8 * sizeof(unsigned long);
+    unsigned long mask[1024 / bits] = {0};
+
+    if (node >= 1024) {
+        return;
+    }
+    mask[node / bits] = 1UL << (node % bits);
+    syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, 1024, 0);
+}
+#endif
+
+VComputerFleet::VComputerFleet (unsigned count, std::size_t ram_size, int numa_node) :
+    count(count), arena(nullptr), heap_block(nullptr), huge_pages(false) {
+
+    vc_stride  = AlignUp(sizeof(VComputer), CacheLineSize);
+    ram_stride = AlignUp(ram_size, HostPageSize);
+    const std::size_t ram_offset = AlignUp(vc_stride * count, HostPageSize);
+    arena_size = ram_offset + ram_stride * count;
+
+#if defined(__linux__)
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (arena_size >= HugePageSize) {
+        // Only works if the system has reserved huge pages
+        const std::size_t huge_size = AlignUp(arena_size, HugePageSize);
+        p = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            arena_size = huge_size;
+            huge_pages = true;
+        }
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+        if (p != MAP_FAILED && arena_size >= HugePageSize) {
+            // Transparent huge pages
+            huge_pages = madvise(p, arena_size, MADV_HUGEPAGE) == 0;
+        }
+#endif
+    }
+
+    if (p != MAP_FAILED) {
+        arena = (Byte*)p;
+#ifdef SYS_mbind
+        if (numa_node >= 0) {
+            BindToNode(arena, arena_size, numa_node);
+        }
+#endif
+    }
+#endif
+
+    if (arena == nullptr) {
+        // Zeroed heap block, aligned by hand to a host page
+        heap_block = new Byte[arena_size + HostPageSize]();
+        arena = (Byte*)AlignUp((std::size_t)heap_block, HostPageSize);
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        Byte* ram = arena + ram_offset + i * ram_stride;
+        new (arena + i * vc_stride) VComputer(ram_size, ram);
+    }
+}
+
+VComputerFleet::~VComputerFleet () {
+    for (unsigned i = 0; i < count; i++) {
+        (*this)[i].~VComputer();
+    }
+
+    if (heap_block != nullptr) {
+        delete[] heap_block;
+        return;
+    }
+#if defined(__linux__)
+    munmap(arena, arena_size);
+#endif
+}
+
+} // End of namespace computer
+} // End of namespace trillek
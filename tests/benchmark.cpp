@@ -70,7 +70,7 @@ int main(int argc, char* argv[]) {
 
   std::printf("Seed : %d\n", seed);
   std::printf("Runing :\n~1%% @ 1MHz\n~10%% @ 0.5MHz\n~20%% @ 0.2MHz\n~59%% @ 0.1MHz\n~10%% @ 0.01MHz\n");
-  VComputer *vc = new VComputer[n_cpus];
+  VComputerFleet vc(n_cpus);
   for (auto i=0; i< n_cpus; i++) {
     // Add CPU
     unsigned cpu_clk = std::rand() % 100;
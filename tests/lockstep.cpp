@@ -0,0 +1,70 @@
+/**
+ * Trillek Virtual Computer - lockstep.cpp
+ * Runs a ROM on two Virtual Computers, one with the reference CPU core and
+ * other with the optimized core, and reports the first divergence
+ */
+#include "vc.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+int main(int argc, char* argv[]) {
+  using namespace trillek;
+  using namespace trillek::computer;
+
+  if (argc < 4) {
+    std::printf("Usage: %s rom_file tr3200|dcpu16n ticks [interval] [full_interval]\n", argv[0]);
+    std::printf("  tr3200  : interpreter against the basic block translator\n");
+    std::printf("  dcpu16n : phased engine against the whole instructions fast mode\n");
+    return -1;
+  }
+
+  Byte rom[32*1024];
+  const int rom_size = LoadROM(argv[1], rom);
+  if (rom_size <= 0) {
+    std::fprintf(stderr, "An error hapen when was reading the file %s\n", argv[1]);
+    return -1;
+  }
+
+  const std::string cpu_name = argv[2];
+  const unsigned long long ticks = std::strtoull(argv[3], nullptr, 0);
+  const unsigned interval = (argc > 4) ? std::atoi(argv[4]) : 1000;
+  const unsigned full_interval = (argc > 5) ? std::atoi(argv[5]) : 64;
+
+  VComputer ref, test;
+  LockstepCPU cpu;
+  if (cpu_name == "tr3200") {
+    cpu = LOCKSTEP_TR3200;
+    std::unique_ptr<TR3200> jit_cpu(new TR3200());
+    if (! jit_cpu->SetJIT(true) ) {
+      std::fprintf(stderr, "The basic block translator is not available on this host\n");
+      return -1;
+    }
+    ref.SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+    test.SetCPU(std::move(jit_cpu));
+  } else if (cpu_name == "dcpu16n") {
+    cpu = LOCKSTEP_DCPU16N;
+    std::unique_ptr<DCPU16N> phased_cpu(new DCPU16N());
+    phased_cpu->SetFastMode(false);
+    ref.SetCPU(std::move(phased_cpu));
+    test.SetCPU(std::unique_ptr<ICPU>(new DCPU16N()));
+  } else {
+    std::fprintf(stderr, "Unknow CPU %s\n", argv[2]);
+    return -1;
+  }
+
+  for (auto v : {&ref, &test}) {
+    v->SetROM(rom, rom_size);
+    v->On();
+  }
+
+  Lockstep lockstep(ref, test, cpu, interval, full_interval);
+  lockstep.Run(ticks);
+  std::printf("%llu ticks, %llu checks\n", (unsigned long long)lockstep.Ticks(),
+              (unsigned long long)lockstep.Checks());
+  std::printf("%s", lockstep.Report().c_str());
+
+  return lockstep.isDiverged() ? 1 : 0;
+}
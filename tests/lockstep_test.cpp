@@ -0,0 +1,121 @@
+/**
+ * Unit tests of the lockstep differential execution harness
+ */
+#include "lockstep.hpp"
+#include "tr3200/tr3200.hpp"
+#include "dcpu16n/dcpu16n.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+// Interpreter against translator, until the RAM of one is changed
+TEST(Lockstep, TR3200) {
+  using namespace trillek::computer;
+  using trillek::DWord;
+
+  const trillek::Byte boot[] = {0x00, 0x04, 0x80, 0x25}; // JMP 0x1000
+  const DWord code[] = {
+    0x40800000 | (1 << 18) | 1,             // MOV %r1, 1
+    0x84000000 | (2 << 18) | (2 << 14) | 1, // ADD %r2, %r2, %r1
+    0x48800000 | (2 << 18) | 0x8000,        // STORE2 [0x8000], %r2
+    0x25800000 | (0x1000 >> 2),             // JMP 0x1000
+  };
+  VComputer ref, test;
+  TR3200* jit_cpu = new TR3200();
+  jit_cpu->SetJIT(true);
+  ref.SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+  test.SetCPU(std::unique_ptr<ICPU>(jit_cpu));
+  for (auto v : {&ref, &test}) {
+    v->SetROM(boot, sizeof(boot));
+    v->On();
+    for (unsigned i = 0; i < sizeof(code) / 4; i++) {
+      v->WriteDW(0x1000 + i * 4, code[i]);
+    }
+  }
+
+  Lockstep lockstep(ref, test, LOCKSTEP_TR3200, 1000);
+  ASSERT_TRUE(lockstep.Run(200000)) << lockstep.Report();
+  ASSERT_EQ(200, lockstep.Checks());
+  ASSERT_EQ(200000, lockstep.Ticks());
+  ASSERT_NE(0, ref.ReadDW(0x8000));
+
+  test.WriteB(0x9001, 0x55);
+  ASSERT_FALSE(lockstep.Run(200000));
+  ASSERT_EQ(201000, lockstep.Ticks());
+  const LockstepDivergence& div = lockstep.Divergence();
+  ASSERT_EQ(200000, div.last_match);
+  ASSERT_EQ("RAM 0x009001 : reference 0x00, test 0x55", div.what);
+  ASSERT_EQ(div.ref_pc, div.test_pc);
+  ASSERT_FALSE(div.ref_inst.empty());
+  ASSERT_NE(std::string::npos, lockstep.Report().find(div.what));
+
+  // Stays stopped on the divergence
+  ASSERT_FALSE(lockstep.Run(1000));
+  ASSERT_EQ(201000, lockstep.Ticks());
+}
+
+// Phased engine against whole instructions, until the code of one is changed
+TEST(Lockstep, DCPU16N) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+  using trillek::Word;
+
+  const Byte boot[] = {0x81, 0x7F, 0x00, 0x10}; // SET PC, 0x1000
+  const Word code[] = {
+    0x03C1, 0x3000, // SET [0x3000], A
+    0x8802,         // ADD A, 1
+    0x7F81, 0x1000, // SET PC, 0x1000
+  };
+  VComputer ref, test;
+  DCPU16N* phased_cpu = new DCPU16N();
+  phased_cpu->SetFastMode(false);
+  ref.SetCPU(std::unique_ptr<ICPU>(phased_cpu));
+  test.SetCPU(std::unique_ptr<ICPU>(new DCPU16N()));
+  for (auto v : {&ref, &test}) {
+    v->SetROM(boot, sizeof(boot));
+    v->On();
+    for (unsigned i = 0; i < sizeof(code) / 2; i++) {
+      v->WriteW(0x1000 + i * 2, code[i]);
+    }
+  }
+
+  Lockstep lockstep(ref, test, LOCKSTEP_DCPU16N, 770);
+  ASSERT_TRUE(lockstep.Run(100000)) << lockstep.Report();
+  ASSERT_NE(0, ref.ReadW(0x3000));
+
+  test.WriteW(0x1004, 0x8C02); // ADD A, 2
+  ASSERT_FALSE(lockstep.Run(100000));
+  const LockstepDivergence& div = lockstep.Divergence();
+  ASSERT_EQ(0, div.what.find("r[0] : ")) << div.what;
+  ASSERT_FALSE(div.ref_inst.empty());
+  ASSERT_FALSE(div.test_inst.empty());
+}
+
+// Writes that skip the dirty tracking are found by the periodic full compare
+TEST(Lockstep, FullCompare) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+
+  const Byte boot[] = {0x81, 0x7F, 0x00, 0x10}; // SET PC, 0x1000
+  VComputer ref, test;
+  DCPU16N* phased_cpu = new DCPU16N();
+  phased_cpu->SetFastMode(false);
+  ref.SetCPU(std::unique_ptr<ICPU>(phased_cpu));
+  test.SetCPU(std::unique_ptr<ICPU>(new DCPU16N()));
+  for (auto v : {&ref, &test}) {
+    v->SetROM(boot, sizeof(boot));
+    v->On();
+    v->WriteW(0x1000, 0x7F81); // SET PC, 0x1000
+    v->WriteW(0x1002, 0x1000);
+  }
+
+  Lockstep lockstep(ref, test, LOCKSTEP_DCPU16N, 1000, 4);
+  ASSERT_TRUE(lockstep.Run(10000)) << lockstep.Report();
+  ASSERT_EQ(10, lockstep.Checks());
+
+  test.Ram()[0x9002] = 0x77;
+  ASSERT_FALSE(lockstep.Run(10000));
+  ASSERT_EQ(12, lockstep.Checks()); // Checks 11 (dirty pages) and 12 (full)
+  ASSERT_EQ("RAM 0x009002 : reference 0x00, test 0x77", lockstep.Divergence().what);
+}
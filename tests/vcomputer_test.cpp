@@ -2,6 +2,12 @@
  * Unit tests of VComputer
  */
 #include "vcomputer.hpp"
+#include "vcomputer_fleet.hpp"
+#include "tr3200/tr3200.hpp"
+#include "tr3200/tr3200_opcodes.hpp"
+#include "tr3200/dis_tr3200.hpp"
+#include "dcpu16n/dcpu16n.hpp"
+#include "code_profiler.hpp"
 #include "devices/dummy_device.hpp"
 #include "devices/debug_serial_console.hpp"
 
@@ -11,6 +17,8 @@
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
+#include <sstream>
+#include <vector>
 
 class TestAddrListener : public trillek::computer::AddrListener {
   public:
@@ -301,3 +309,1183 @@ TEST_F(VComputer_test, DummyDevice_EnumAndCtrl) {
   ASSERT_EQ(0xA0F5, valw);
 
 }
+
+TEST_F(VComputer_test, AddrDecoder_SharedPages) {
+  auto ddev = std::make_shared<trillek::computer::DummyDevice>();
+  auto ddev2 = std::make_shared<trillek::computer::DummyDevice>();
+  ASSERT_TRUE(vc.AddDevice(0, ddev));
+  ASSERT_TRUE(vc.AddDevice(1, ddev2));
+
+  // Two Enumeration and Control blocks on the same page
+  ASSERT_EQ(0xFF, vc.ReadB(0x110000));
+  ASSERT_EQ(0xFF, vc.ReadB(0x110100));
+  ASSERT_EQ(0x00, vc.ReadB(0x110200));
+  ASSERT_EQ(0x00, vc.ReadB(0x110015)) << "Read outside of the listener range";
+
+  // Small embed devices sharing a page : PIT and RNG
+  vc.WriteDW(0x11E004, 0x12345678);
+  ASSERT_EQ(0x12345678, vc.ReadDW(0x11E004));
+  ASSERT_EQ(0x00, vc.ReadB(0x11E018)) << "Read on a hole between devices";
+
+  // Two listeners on the same 16 byte line
+  TestAddrListener t_addr1;
+  TestAddrListener t_addr2;
+  auto id1 = vc.AddAddrListener(trillek::computer::Range(0x120000, 0x120003), &t_addr1);
+  auto id2 = vc.AddAddrListener(trillek::computer::Range(0x120004, 0x120007), &t_addr2);
+  ASSERT_NE(-1, id1);
+  ASSERT_NE(-1, id2);
+
+  vc.ReadB(0x120003);
+  vc.ReadB(0x120004);
+  vc.ReadB(0x120008);
+  ASSERT_EQ(1, t_addr1.readCount);
+  ASSERT_EQ(1, t_addr2.readCount);
+
+  // Removing a device, removes his Enumeration and Control block
+  vc.RmDevice(1);
+  ASSERT_EQ(0x00, vc.ReadB(0x110100));
+  ASSERT_EQ(0xFF, vc.ReadB(0x110000));
+
+  ASSERT_TRUE(vc.RmAddrListener(id1));
+  ASSERT_TRUE(vc.RmAddrListener(id2));
+}
+
+// Fills the listeners cap with listeners that share each page with the next
+TEST_F(VComputer_test, AddrListener_Cap) {
+  using trillek::computer::Range;
+  std::vector<TestAddrListener> t_addr(trillek::computer::MAX_ADDR_LISTENERS);
+  std::vector<int32_t> ids;
+  for (unsigned i = 0; i < t_addr.size(); i++) {
+    const trillek::DWord start = 0x200800 + i * 0x1000;
+    auto id = vc.AddAddrListener(Range(start, start + 0xFFF), &t_addr[i]);
+    if (id == -1) {
+      break;
+    }
+    ids.push_back(id);
+  }
+  ASSERT_EQ(trillek::computer::MAX_ADDR_LISTENERS, vc.GetMMIOProfile().size());
+  ASSERT_GT(ids.size(), 100u);
+
+  // Each listener gets only his half of the shared pages
+  for (unsigned i = 0; i < ids.size(); i++) {
+    vc.ReadB(0x200800 + i * 0x1000);
+    vc.ReadB(0x2017FF + i * 0x1000);
+    ASSERT_EQ(2, t_addr[i].readCount) << "Listener " << i;
+  }
+
+  for (auto id : ids) {
+    ASSERT_TRUE(vc.RmAddrListener(id));
+  }
+}
+
+TEST_F(VComputer_test, RAM_Listener_Overlay) {
+  TestAddrListener t_addr;
+  auto id = vc.AddAddrListener(trillek::computer::Range(0x001000, 0x0010FF), &t_addr);
+  ASSERT_NE(-1, id);
+
+  // Stores on a page without listeners not touch the listener
+  vc.WriteB(0x000FFF, 0x11);
+  vc.WriteDW(0x002000, 0xCAFEBABE);
+  ASSERT_EQ(0, t_addr.writeCount);
+  ASSERT_EQ(0x11, vc.ReadB(0x000FFF));
+  ASSERT_EQ(0xCAFEBABE, vc.ReadDW(0x002000));
+
+  // Stores on the listened page goes to RAM and to the listener
+  vc.WriteB(0x001010, 0x22);
+  vc.WriteW(0x001020, 0x3344);
+  ASSERT_EQ(3, t_addr.writeCount);
+  ASSERT_EQ(0x22, vc.ReadB(0x001010));
+  ASSERT_EQ(0x3344, vc.ReadW(0x001020));
+
+  // Same page, but outside of the listener range
+  vc.WriteB(0x001100, 0x55);
+  ASSERT_EQ(3, t_addr.writeCount);
+  ASSERT_EQ(0x55, vc.ReadB(0x001100));
+
+  ASSERT_TRUE(vc.RmAddrListener(id));
+  vc.WriteB(0x001010, 0x66);
+  ASSERT_EQ(3, t_addr.writeCount);
+}
+
+TEST_F(VComputer_test, RW_RAM_Straddling) {
+  const trillek::DWord end = vc.RamSize();
+
+  // A DWord that falls half in RAM and half outside only uses the RAM part
+  vc.WriteDW(end - 2, 0xAABBCCDD);
+  ASSERT_EQ(0xCCDD, vc.ReadW(end - 2));
+  ASSERT_EQ(0xDD, vc.ReadB(end - 2));
+  ASSERT_EQ(0xCC, vc.ReadB(end - 1));
+  ASSERT_EQ(0x0000CCDD, vc.ReadDW(end - 2));
+
+  vc.WriteW(end - 1, 0x1122);
+  ASSERT_EQ(0x22, vc.ReadB(end - 1));
+  ASSERT_EQ(0x0022, vc.ReadW(end - 1));
+
+  // Unaligned access inside RAM
+  vc.WriteDW(0x000103, 0x01020304);
+  ASSERT_EQ(0x01020304, vc.ReadDW(0x000103));
+  ASSERT_EQ(0x0203, vc.ReadW(0x000104));
+  ASSERT_EQ(0x01020304, vc.Read<trillek::DWord>(0x000103));
+
+  // Reads that straddle the end of the ROM
+  ASSERT_EQ(0, vc.ReadB(0x100000 + 1024));
+  ASSERT_EQ(0, vc.ReadDW(0x100000 + 1022));
+
+  // Reads just before the ROM are not taken as ROM reads
+  ASSERT_EQ(0, vc.ReadDW(0x0FFFFC));
+  ASSERT_EQ(0, vc.ReadW(0x0FFFFE));
+  ASSERT_EQ(0, vc.Fetch<trillek::DWord>(0x0FFFFC));
+}
+
+TEST_F(VComputer_test, CloneFrom_CopyOnWrite) {
+  std::unique_ptr<trillek::computer::TR3200> cpu(new trillek::computer::TR3200());
+  vc.SetCPU(std::move(cpu));
+  vc.On();
+  vc.WriteDW(0x000200, 0xCAFEBABE);
+  vc.WriteB(vc.RamSize() - 1, 0x5A);
+
+  auto image = vc.SnapshotRAM();
+  ASSERT_TRUE((bool)image);
+
+  trillek::computer::VComputer clone1;
+  trillek::computer::VComputer clone2(image); // RAM is a view of the image
+  ASSERT_EQ(vc.RamSize(), clone2.RamSize());
+  ASSERT_EQ(0xCAFEBABE, clone2.ReadDW(0x000200));
+  std::unique_ptr<trillek::computer::TR3200> cpu1(new trillek::computer::TR3200());
+  clone1.SetCPU(std::move(cpu1));
+  ASSERT_TRUE(clone1.CloneFrom(vc, image));
+  ASSERT_TRUE(clone2.CloneFrom(vc, image));
+
+  ASSERT_TRUE(clone1.isOn());
+  ASSERT_FALSE(clone2.isOn()); // Not have CPU
+  ASSERT_EQ(0xCAFEBABE, clone1.ReadDW(0x000200));
+  ASSERT_EQ(0x5A, clone1.ReadB(vc.RamSize() - 1));
+  ASSERT_EQ('H', clone1.ReadB(0x100000)); // Shares the ROM
+
+  // Writes are private of each computer
+  clone1.WriteDW(0x000200, 0x12345678);
+  vc.WriteDW(0x000200, 0xDEADBEEF);
+  ASSERT_EQ(0x12345678, clone1.ReadDW(0x000200));
+  ASSERT_EQ(0xCAFEBABE, clone2.ReadDW(0x000200));
+  ASSERT_EQ(0xDEADBEEF, vc.ReadDW(0x000200));
+  ASSERT_EQ(0xBE, image->Data()[0x200]);
+  ASSERT_EQ(0xCA, image->Data()[0x203]);
+
+  // Powering on not clears a RAM cloned from an image
+  std::unique_ptr<trillek::computer::TR3200> cpu2(new trillek::computer::TR3200());
+  clone2.SetCPU(std::move(cpu2));
+  clone2.On();
+  ASSERT_EQ(0xCAFEBABE, clone2.ReadDW(0x000200));
+
+  trillek::computer::VComputer other(64*1024);
+  ASSERT_FALSE(other.CloneFrom(vc, image));
+
+  // A null image gives a plain computer, and can't be loaded
+  trillek::computer::VComputer plain(std::shared_ptr<const trillek::computer::RamImage>(nullptr));
+  ASSERT_EQ(128*1024, plain.RamSize());
+  ASSERT_EQ(0, plain.ReadDW(0x000200));
+  ASSERT_FALSE(plain.LoadRAMImage(nullptr));
+}
+
+#if !defined(_WIN32)
+TEST_F(VComputer_test, MapRAMFile_Persists) {
+  const char* filename = "vc_ram_test.bin";
+  std::remove(filename);
+  {
+    trillek::computer::VComputer vc1;
+    ASSERT_TRUE(vc1.MapRAMFile(filename));
+    ASSERT_EQ(0, vc1.ReadDW(0x000400)); // New file is filled of zeros
+    vc1.WriteDW(0x000400, 0x600DF00D);
+    ASSERT_TRUE(vc1.SyncRAMFile(true));
+  }
+
+  trillek::computer::VComputer vc2;
+  ASSERT_FALSE(vc2.SyncRAMFile());
+  ASSERT_TRUE(vc2.MapRAMFile(filename));
+  std::unique_ptr<trillek::computer::TR3200> cpu(new trillek::computer::TR3200());
+  vc2.SetCPU(std::move(cpu));
+  vc2.On(); // Not clears mapped RAM
+  ASSERT_EQ(0x600DF00D, vc2.ReadDW(0x000400));
+  ASSERT_EQ(0x0D, vc2.Ram()[0x000400]);
+
+  std::remove(filename);
+}
+#endif
+
+TEST_F(VComputer_test, DirtyPages) {
+  vc.WriteB(0x000010, 1);
+  ASSERT_TRUE(vc.isDirtyPage(0x000000)); // Without tracking, all is dirty
+  ASSERT_TRUE(vc.GetDirtyPages().empty());
+
+  vc.SetDirtyTracking(true);
+  ASSERT_TRUE(vc.isDirtyTracking());
+  ASSERT_FALSE(vc.isDirtyPage(0x000000));
+
+  vc.WriteB(0x000010, 2);
+  vc.WriteDW(0x001FFE, 0x11223344); // Crosses two pages
+  vc.WriteW(0x003000, 0x5566);
+  vc.WriteW(0x003002, 0x7788);
+  vc.ReadDW(0x005000);
+  ASSERT_EQ(0x11223344, vc.ReadDW(0x001FFE));
+
+  auto pages = vc.GetDirtyPages();
+  ASSERT_EQ(4, pages.size());
+  ASSERT_EQ(0x000000, pages[0]);
+  ASSERT_EQ(0x001000, pages[1]);
+  ASSERT_EQ(0x002000, pages[2]);
+  ASSERT_EQ(0x003000, pages[3]);
+  ASSERT_FALSE(vc.isDirtyPage(0x004000));
+  ASSERT_FALSE(vc.isDirtyPage(0x005000));
+
+  vc.ClearDirtyPages();
+  ASSERT_TRUE(vc.GetDirtyPages().empty());
+  vc.WriteB(vc.RamSize() - 1, 0xAA);
+  ASSERT_TRUE(vc.isDirtyPage(vc.RamSize() - 1));
+  ASSERT_EQ(1, vc.GetDirtyPages().size());
+
+  // Listener over RAM still is called on a tracked page
+  TestAddrListener t_addr;
+  trillek::computer::Range r(0x006000, 0x006003);
+  vc.AddAddrListener(r, &t_addr);
+  vc.WriteB(0x006001, 0x01);
+  vc.WriteB(0x006002, 0x02);
+  ASSERT_EQ(2, t_addr.writeCount);
+  ASSERT_TRUE(vc.isDirtyPage(0x006000));
+
+  vc.SetDirtyTracking(false);
+  ASSERT_FALSE(vc.isDirtyTracking());
+  ASSERT_TRUE(vc.GetDirtyPages().empty());
+}
+
+TEST_F(VComputer_test, DmaReadWrite) {
+  trillek::Byte buf[0x2100];
+  for (unsigned i = 0; i < sizeof(buf); i++) {
+    buf[i] = i * 7;
+  }
+
+  vc.SetDirtyTracking(true);
+  TestAddrListener t_addr;
+  trillek::computer::Range r(0x004010, 0x00401F);
+  vc.AddAddrListener(r, &t_addr);
+
+  // Crosses some pages, one of them with a listener over RAM
+  vc.DmaWrite(0x002F00, buf, sizeof(buf));
+  ASSERT_EQ(16, t_addr.writeCount);
+  for (unsigned i = 0; i < sizeof(buf); i++) {
+    ASSERT_EQ(buf[i], vc.ReadB(0x002F00 + i));
+  }
+  auto pages = vc.GetDirtyPages();
+  ASSERT_EQ(3, pages.size());
+  ASSERT_EQ(0x002000, pages[0]);
+  ASSERT_EQ(0x004000, pages[2]);
+
+  trillek::Byte out[sizeof(buf)];
+  vc.DmaRead(0x002F00, out, sizeof(out));
+  ASSERT_EQ(0, std::memcmp(buf, out, sizeof(buf)));
+
+  // ROM and unmapped addresses
+  vc.DmaRead(0x100000 + 1020, out, 8);
+  ASSERT_EQ(0, out[3]);
+  ASSERT_EQ(0, out[4]);
+  vc.DmaRead(0x100000, out, 5);
+  ASSERT_EQ(0, std::memcmp("Hello", out, 5));
+}
+
+TEST_F(VComputer_test, WatchPoints) {
+  vc.SetWatchPoint(0x003010, 4, trillek::computer::VComputer::WATCH_WRITE);
+  vc.SetWatchPoint(0x100004, 1, trillek::computer::VComputer::WATCH_READ);
+
+  // Same page, but not watched address
+  vc.WriteB(0x003000, 0x11);
+  vc.ReadB(0x003010);
+  ASSERT_FALSE(vc.isHalted());
+  ASSERT_EQ(0x11, vc.ReadB(0x003000));
+
+  // Write that overlaps the watched range, is done and halts
+  vc.WriteDW(0x00300E, 0xAABBCCDD);
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(0x00300E, vc.LastWatchPoint());
+  ASSERT_EQ(0xAABBCCDD, vc.ReadDW(0x00300E));
+  vc.Resume();
+  ASSERT_FALSE(vc.isHalted());
+
+  // ROM read watchpoint
+  ASSERT_EQ('l', vc.ReadB(0x100003));
+  ASSERT_FALSE(vc.isHalted());
+  ASSERT_EQ(0x6F6C6C65, vc.ReadDW(0x100001)); // "ello"
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(0x100001, vc.LastWatchPoint());
+  vc.Resume();
+
+  vc.RmWatchPoint(0x003010);
+  vc.WriteB(0x003011, 0x22);
+  ASSERT_FALSE(vc.isHalted());
+  vc.ClearWatchPoints();
+  vc.ReadB(0x100004);
+  ASSERT_FALSE(vc.isHalted());
+
+  // DMA transfers
+  trillek::Byte buf[0x100] = {0};
+  vc.SetWatchPoint(0x005080, 1, trillek::computer::VComputer::WATCH_READ);
+  vc.DmaWrite(0x005000, buf, sizeof(buf));
+  ASSERT_FALSE(vc.isHalted());
+  vc.DmaRead(0x005000, buf, sizeof(buf));
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(0x005000, vc.LastWatchPoint());
+  vc.Resume();
+  vc.ClearWatchPoints();
+  vc.SetWatchPoint(0x0050FF, 1, trillek::computer::VComputer::WATCH_WRITE);
+  vc.DmaRead(0x005000, buf, sizeof(buf));
+  ASSERT_FALSE(vc.isHalted());
+  vc.DmaWrite(0x005000, buf, sizeof(buf));
+  ASSERT_TRUE(vc.isHalted());
+  vc.Resume();
+  vc.ClearWatchPoints();
+
+  // Watchpoints at the end of the address space are clamped to it
+  vc.SetWatchPoint(0xFFFFFF, 2);
+  vc.SetWatchPoint(0x7FFFFF00, 0x200);
+  vc.ReadB(0xFFFFFF);
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(0xFFFFFF, vc.LastWatchPoint());
+  vc.Resume();
+  vc.RmWatchPoint(0xFFFFFF);
+  vc.ReadB(0xFFFF00);
+  ASSERT_TRUE(vc.isHalted());
+  vc.Resume();
+  vc.ClearWatchPoints();
+}
+
+TEST_F(VComputer_test, BusProfiler) {
+  TestAddrListener t_addr;
+  trillek::computer::Range r(0x120000, 0x120003);
+  vc.AddAddrListener(r, &t_addr);
+
+  vc.WriteB(0x000010, 1);
+  ASSERT_FALSE(vc.isProfiling());
+  ASSERT_TRUE(vc.GetPageProfile().empty());
+
+  vc.SetProfiling(true);
+  vc.WriteB(0x000010, 2);
+  vc.WriteDW(0x000020, 3);
+  vc.ReadW(0x000010);
+  vc.Fetch<trillek::DWord>(0x100000);
+  vc.Fetch<trillek::DWord>(0x100004);
+  vc.ReadB(0x120001);
+  vc.WriteB(0x120002, 5);
+  ASSERT_EQ(2, vc.ReadB(0x000010));
+  ASSERT_EQ(2, t_addr.readCount + t_addr.writeCount);
+
+  const auto& pages = vc.GetPageProfile();
+  ASSERT_EQ(2, pages[0].reads);
+  ASSERT_EQ(2, pages[0].writes);
+  ASSERT_EQ(0, pages[0].fetches);
+  ASSERT_EQ(2, pages[0x100000 >> trillek::computer::BusPageShift].fetches);
+  ASSERT_EQ(1, pages[0x120000 >> trillek::computer::BusPageShift].reads);
+
+  bool found = false;
+  for (const auto& c : vc.GetMMIOProfile()) {
+    if (c.start == 0x120000) {
+      found = true;
+      ASSERT_EQ(0x120003, c.end);
+      ASSERT_EQ(1, c.reads);
+      ASSERT_EQ(1, c.writes);
+    }
+  }
+  ASSERT_TRUE(found);
+
+  std::ostringstream csv;
+  vc.WriteProfileCSV(csv);
+  ASSERT_NE(std::string::npos, csv.str().find("page,0,4095,2,2,0\n"));
+  ASSERT_NE(std::string::npos, csv.str().find("mmio,1179648,1179651,1,1,0\n"));
+
+  // Accesses split in bytes and DMA chunks count once
+  vc.ClearProfile();
+  const trillek::DWord end = vc.RamSize();
+  vc.ReadDW(end - 2);
+  vc.WriteDW(end - 2, 0x11223344);
+  vc.ReadDW(0x100000 + 1022);
+  ASSERT_EQ(1, pages[(end - 2) >> trillek::computer::BusPageShift].reads);
+  ASSERT_EQ(1, pages[(end - 2) >> trillek::computer::BusPageShift].writes);
+  ASSERT_EQ(1, pages[(0x100000 + 1022) >> trillek::computer::BusPageShift].reads);
+
+  trillek::Byte buf[0x1100];
+  vc.DmaRead(0x001800, buf, sizeof(buf));
+  vc.DmaWrite(0x120000, buf, 4);
+  ASSERT_EQ(1, pages[1].reads);
+  ASSERT_EQ(1, pages[2].reads);
+  ASSERT_EQ(1, pages[0x120000 >> trillek::computer::BusPageShift].writes);
+  for (const auto& c : vc.GetMMIOProfile()) {
+    if (c.start == 0x120000) {
+      ASSERT_EQ(4, c.writes); // Byte a byte to the listener
+    }
+  }
+
+  vc.SetProfiling(false);
+  vc.ReadB(0x000010);
+  ASSERT_EQ(0, vc.GetPageProfile()[0].reads);
+}
+
+TEST_F(VComputer_test, VComputerFleet) {
+  trillek::computer::VComputerFleet fleet(8, 64*1024);
+  ASSERT_EQ(8, fleet.Size());
+
+  for (unsigned i = 0; i < fleet.Size(); i++) {
+    trillek::computer::VComputer& v = fleet[i];
+    ASSERT_EQ(64*1024, v.RamSize());
+    ASSERT_EQ(0, (std::size_t)v.Ram() % trillek::computer::VComputerFleet::HostPageSize);
+    ASSERT_EQ(0, (std::size_t)&v % trillek::computer::VComputerFleet::CacheLineSize);
+    ASSERT_EQ(0, v.ReadDW(0x00FFFC));
+    v.WriteDW(0x00FFFC, i);
+    v.SetROM(rom, 1024);
+  }
+
+  for (unsigned i = 0; i < fleet.Size(); i++) {
+    ASSERT_EQ(i, fleet[i].ReadDW(0x00FFFC));
+    ASSERT_EQ('H', fleet[i].ReadB(0x100000));
+  }
+
+  // Replacing the RAM of a fleet computer not frees the arena chunk
+  auto image = fleet[0].SnapshotRAM();
+  ASSERT_TRUE(fleet[1].LoadRAMImage(image));
+  ASSERT_EQ(0, fleet[1].ReadDW(0x00FFFC));
+}
+
+TEST_F(VComputer_test, TR3200_SelfModifyingCode) {
+  using trillek::DWord;
+  std::unique_ptr<trillek::computer::TR3200> cpu(new trillek::computer::TR3200());
+  vc.SetCPU(std::move(cpu));
+  vc.On();
+
+  // MOV %r1, lit
+  auto mov_r1 = [] (DWord lit) -> DWord { return 0x40000000 | 0x00800000 | (1 << 18) | lit; };
+  vc.WriteDW(0x001000, mov_r1(5));
+  vc.WriteDW(0x001004, 0x48000000 | 0x00800000 | (2 << 18) | 0x1000); // STORE2 [0x1000], %r2
+
+  trillek::computer::TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x001000;
+  state.r[2] = mov_r1(9);
+  vc.SetState(&state, sizeof(state));
+
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(5, state.r[1]);
+
+  // A write from the bus invalidates the cached instruction
+  vc.WriteDW(0x001000, mov_r1(7));
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(7, state.r[1]);
+
+  // A store from the CPU too
+  vc.Step();
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(9, state.r[1]);
+
+  // Raw writes need a flush
+  vc.Ram()[0x001000] = 3;
+  vc.FlushCodeCache();
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(3, state.r[1]);
+}
+
+TEST_F(VComputer_test, TR3200_JITLockstep) {
+  using namespace trillek::computer;
+  using trillek::DWord;
+
+  // Random code at 0x1000 that ends jumping back to it. Mostly register
+  // only instructions, mixed with skips, loads and stores
+  const trillek::Byte ops[] = {
+    P3_OPCODE::AND, P3_OPCODE::OR, P3_OPCODE::XOR, P3_OPCODE::BITC,
+    P3_OPCODE::ADD, P3_OPCODE::ADDC, P3_OPCODE::SUB, P3_OPCODE::SUBB,
+    P3_OPCODE::RSB, P3_OPCODE::RSBB, P3_OPCODE::LLS, P3_OPCODE::RLS,
+    P3_OPCODE::ARS, P3_OPCODE::MUL, P3_OPCODE::ROTL,
+    P2_OPCODE::MOV, P2_OPCODE::SWP, P2_OPCODE::NOT, P2_OPCODE::IFL,
+    P2_OPCODE::IFEQ, P2_OPCODE::LOAD2, P2_OPCODE::STORE2 };
+  std::srand(1234);
+  std::vector<DWord> code;
+  code.push_back(0x40800000 | (1 << 18) | 1);                // MOV %r1, 1
+  code.push_back(0x84000000 | (2 << 18) | (2 << 14) | 1);    // ADD %r2, %r2, %r1
+  for (unsigned i = 0; i < 400; i++) {
+    const DWord op = ops[std::rand() % sizeof(ops)];
+    const DWord rd = std::rand() % 13;
+    DWord inst = (op << 24) | (rd << 18);
+    if (op == P2_OPCODE::LOAD2 || op == P2_OPCODE::STORE2) {
+      code.push_back(inst | 0x00800000 | (0x8000 + (std::rand() & 0x7FFC)));
+      continue;
+    }
+    if (op & 0x80) {
+      inst |= (std::rand() % 16) << 14; // Rs
+    }
+    switch (std::rand() % 4) {
+    case 0: // Small literal
+      code.push_back(inst | 0x00800000 | (std::rand() % 40));
+      break;
+    case 1: // Big literal
+      code.push_back(inst | 0x00C00000);
+      code.push_back(std::rand() * 65599u);
+      break;
+    default: // Register
+      code.push_back(inst | (std::rand() % 16));
+      break;
+    }
+  }
+  code.push_back(0x25800000 | (0x1000 >> 2)); // JMP 0x1000
+
+  const trillek::Byte boot[] = {0x00, 0x04, 0x80, 0x25}; // JMP 0x1000
+  trillek::computer::VComputer vc2;
+  VComputer* vms[2] = {&vc, &vc2};
+  TR3200* jit_cpu = new TR3200();
+  jit_cpu->SetJIT(true); // Without it, both VMs use the interpreter
+  vc2.SetCPU(std::unique_ptr<ICPU>(jit_cpu));
+  vc.SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+  for (auto v : vms) {
+    v->SetROM(boot, 4);
+    v->On();
+    for (unsigned i = 0; i < code.size(); i++) {
+      v->WriteDW(0x1000 + i * 4, code[i]);
+    }
+  }
+
+  TR3200State s1, s2;
+  for (unsigned step = 0; step < 3000; step++) {
+    if (step == 1500) {
+      // Self modifying code : MOV %r1, 0x1234
+      for (auto v : vms) {
+        v->WriteDW(0x1000, 0x40800000 | (1 << 18) | 0x1234);
+      }
+    }
+    const unsigned ticks = 10 * (1 + std::rand() % 200);
+    vc.Tick(ticks);
+    vc2.Tick(ticks);
+
+    std::size_t size = sizeof(s1);
+    vc.GetState(&s1, size);
+    vc2.GetState(&s2, size);
+    ASSERT_EQ(s1.pc, s2.pc) << "at step " << step;
+    for (unsigned i = 0; i < TR3200::TR3200_NGPRS; i++) {
+      ASSERT_EQ(s1.r[i], s2.r[i]) << "%r" << i << " at step " << step;
+    }
+    ASSERT_EQ(s1.wait_cycles, s2.wait_cycles);
+    ASSERT_EQ(s1.skiping, s2.skiping);
+    ASSERT_EQ(0, std::memcmp(vc.Ram(), vc2.Ram(), vc.RamSize())) << "at step " << step;
+  }
+}
+
+TEST_F(VComputer_test, TR3200_JITInvalidate_CrossPage) {
+  using namespace trillek::computer;
+
+  // A block that crosses the page boundary at 0x2000, and a store of the
+  // code in a neighbour page
+  const trillek::Byte boot[] = {0xFE, 0x07, 0x80, 0x25}; // JMP 0x1FF8
+  TR3200* cpu = new TR3200();
+  cpu->SetJIT(true);
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.SetROM(boot, 4);
+  vc.On();
+  vc.WriteDW(0x001FF8, 0x84800000 | (2 << 18) | (2 << 14) | 1); // ADD %r2, %r2, 1
+  vc.WriteDW(0x001FFC, 0x84800000 | (3 << 18) | (3 << 14) | 1); // ADD %r3, %r3, 1
+  vc.WriteDW(0x002000, 0x84800000 | (4 << 18) | (4 << 14) | 1); // ADD %r4, %r4, 1
+  vc.WriteDW(0x002004, 0x25800000 | (0x1FF8 >> 2));             // JMP 0x1FF8
+
+  // Runs and stops at the begin of the loop
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  auto run = [&]() {
+    vc.Tick(10000);
+    for (vc.GetState(&state, size); state.pc != 0x1FF8; vc.GetState(&state, size)) {
+      vc.Step();
+    }
+  };
+  run();
+  ASSERT_NE(0u, state.r[2]);
+  ASSERT_EQ(state.r[2], state.r[4]);
+
+  // Data writes on the second page not touch the block
+  vc.WriteDW(0x002800, 0x12345678);
+  run();
+  ASSERT_EQ(state.r[2], state.r[4]);
+
+  // Changing the code on the second page drops the whole block
+  vc.WriteDW(0x002000, 0x84800000 | (4 << 18) | (4 << 14) | 5); // ADD %r4, %r4, 5
+  const trillek::DWord r2 = state.r[2], r4 = state.r[4];
+  run();
+  ASSERT_LT(r2, state.r[2]);
+  ASSERT_EQ(r4 + 5 * (state.r[2] - r2), state.r[4]);
+}
+
+TEST_F(VComputer_test, TR3200_UnwatchCode) {
+  using namespace trillek::computer;
+  TR3200* cpu = new TR3200();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+
+  vc.WriteDW(0x003000, 0x40800000 | (1 << 18) | 1); // MOV %r1, 1
+  vc.WriteDW(0x003004, 0x40800000 | (2 << 18) | 2); // MOV %r2, 2
+  std::size_t size = 0;
+  ASSERT_NE(nullptr, vc.WritePointer(0x003000, size));
+
+  TR3200State state;
+  size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x003000;
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  vc.Step();
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size)); // Has cached code
+
+  // Stays trapped while some instruction of the page is cached
+  vc.WriteDW(0x003800, 0x12345678);
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size));
+  vc.WriteDW(0x003000, 0x40800000 | (1 << 18) | 3); // MOV %r1, 3
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size));
+
+  // The page is a data page again when all his code is invalidated
+  const unsigned version = vc.BusVersion();
+  vc.WriteDW(0x003004, 0x40800000 | (2 << 18) | 4); // MOV %r2, 4
+  ASSERT_NE(version, vc.BusVersion());
+  ASSERT_NE(nullptr, vc.WritePointer(0x003000, size));
+
+  // And runs the new code
+  vc.GetState(&state, size = sizeof(state));
+  state.pc = 0x003000;
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  vc.Step();
+  vc.GetState(&state, size = sizeof(state));
+  ASSERT_EQ(3u, state.r[1]);
+  ASSERT_EQ(4u, state.r[2]);
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size));
+}
+
+TEST_F(VComputer_test, TR3200_TickCycles) {
+  using namespace trillek::computer;
+  TR3200* cpu = new TR3200();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+
+  vc.WriteDW(0x001000, 0x40800000 | (1 << 18) | 1);      // MOV %r1, 1
+  vc.WriteDW(0x001004, 0x40800000 | (2 << 18) | 2);      // MOV %r2, 2
+  vc.WriteDW(0x001008, 0x48800000 | (1 << 18) | 0x8000); // STORE2 [0x8000], %r1
+  vc.SetWatchPoint(0x8000, 4, VComputer::WATCH_WRITE);
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+
+  // Each MOV takes 3 cycles, so the second MOV keeps 2 cycles for later
+  ASSERT_EQ(4, cpu->Tick(4));
+  vc.GetState(&state, size);
+  ASSERT_EQ(2, state.r[2]);
+  ASSERT_EQ(2, state.wait_cycles);
+
+  // Ends the MOV, and the STORE2 halts the CPU
+  ASSERT_EQ(2, cpu->Tick(100));
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(1, vc.ReadDW(0x8000));
+}
+
+TEST_F(VComputer_test, TR3200_LazyFlags) {
+  using namespace trillek::computer;
+  vc.SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+  vc.On();
+
+  vc.WriteDW(0x001000, 0x84800000 | (2 << 18) | (1 << 14) | 1); // ADD %r2, %r1, 1
+  vc.WriteDW(0x001004, 0x85800000 | (3 << 18));                 // ADDC %r3, %r0, 0
+  vc.WriteDW(0x001008, 0x86800000 | (4 << 18) | 1);             // SUB %r4, %r0, 1
+  vc.WriteDW(0x00100C, 0x40000000 | (5 << 18) | 15);            // MOV %r5, %flags
+  vc.WriteDW(0x001010, 0x84800000 | (15 << 18) | (1 << 14) | 1); // ADD %flags, %r1, 1
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc   = 0x001000;
+  state.r[1] = 0xFFFFFFFF;
+  vc.SetState(&state, sizeof(state));
+
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(0, state.r[2]);
+  ASSERT_EQ(1, state.r[15] & 3); // CF
+
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(1, state.r[3]);
+  ASSERT_EQ(0, state.r[15] & 3);
+
+  vc.Step();
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(0xFFFFFFFF, state.r[4]);
+  ASSERT_EQ(3, state.r[5] & 3);  // CF and OF
+  ASSERT_EQ(3, state.r[15] & 3);
+
+  // The result overwrites the flags
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(0, state.r[15]);
+}
+
+TEST_F(VComputer_test, TR3200_Push) {
+  using namespace trillek::computer;
+  vc.SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+  vc.On();
+
+  vc.WriteDW(0x001000, 0x24000000 | 1); // PUSH %r1
+  vc.WriteDW(0x001004, 0x24000000 | 1); // PUSH %r1
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc     = 0x001000;
+  state.r[1]   = 0x12345678;
+  state.r[13]  = 0x008010; // SP
+  vc.SetState(&state, sizeof(state));
+
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(0x00800C, state.r[13]);
+  ASSERT_EQ(0x12345678, vc.ReadDW(0x00800C));
+
+  // A device on the stack sees each byte
+  TestAddrListener t_addr;
+  trillek::computer::Range r(0x008000, 0x00800F);
+  vc.AddAddrListener(r, &t_addr);
+  vc.Step();
+  vc.GetState(&state, size);
+  ASSERT_EQ(0x008008, state.r[13]);
+  ASSERT_EQ(4, t_addr.writeCount);
+}
+
+TEST_F(VComputer_test, TR3200_BreakPoints) {
+  using namespace trillek::computer;
+  TR3200* cpu = new TR3200();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+  cpu->SetJIT(true); // Translated blocks must stop on breakpoints too
+
+  vc.WriteDW(0x001000, 0x84800000 | (1 << 18) | (1 << 14) | 1); // ADD %r1, %r1, 1
+  vc.WriteDW(0x001004, 0x84800000 | (2 << 18) | (2 << 14) | 1); // ADD %r2, %r2, 1
+  vc.WriteDW(0x001008, 0x25800000 | (0x1000 >> 2));            // JMP 0x1000
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+
+  // Code is cached (and translated) before setting the breakpoint
+  cpu->Tick(100);
+  ASSERT_FALSE(vc.isHalted());
+
+  vc.SetBreakPoint(0x001004);
+  ASSERT_TRUE(vc.isBreakPoint(0x001004));
+  ASSERT_FALSE(vc.isBreakPoint(0x001000));
+  cpu->Tick(100);
+  ASSERT_TRUE(vc.isHalted());
+  vc.GetState(&state, size);
+  ASSERT_EQ(0x001004, state.pc);
+  const trillek::DWord r2 = state.r[2];
+  ASSERT_EQ(r2 + 1, state.r[1]);
+
+  // Resume executes the instruction, and the next loop halts again
+  vc.Resume();
+  cpu->Tick(100);
+  ASSERT_TRUE(vc.isHalted());
+  vc.GetState(&state, size);
+  ASSERT_EQ(0x001004, state.pc);
+  ASSERT_EQ(r2 + 1, state.r[2]);
+  ASSERT_EQ(r2 + 2, state.r[1]);
+
+  vc.RmBreakPoint(0x001004);
+  ASSERT_FALSE(vc.isBreakPoint(0x001004));
+  vc.Resume();
+  cpu->Tick(100);
+  ASSERT_FALSE(vc.isHalted());
+}
+
+TEST_F(VComputer_test, TR3200_SleepFastForward) {
+  using namespace trillek::computer;
+  TR3200* cpu = new TR3200();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+
+  vc.WriteDW(0x001000, 0x00000000);                           // SLEEP
+  vc.WriteDW(0x001100, 0x40800000 | (1 << 18) | 0x55);        // MOV %r1, 0x55
+  vc.WriteDW(0x001104, 0x25800000 | (0x1104 >> 2));           // JMP 0x1104
+  vc.WriteDW(0x002004, 0x001100); // TMR0 interrupt vector
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc     = 0x001000;
+  state.r[14]  = 0x002000; // IA
+  state.r[15]  = 0x100;    // EI
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  ASSERT_TRUE(cpu->isSleeping());
+
+  vc.WriteDW(0x11E000, 100);  // TMR0
+  vc.WriteDW(0x11E004, 1000); // Reload value
+  vc.WriteB(0x11E010, 3);     // TMR0 on, with interrupts
+
+  // 10000 device cycles. The CPU wakes up at the first underflow and runs
+  // the handler in the same call
+  vc.Tick(100000);
+  ASSERT_FALSE(cpu->isSleeping());
+  vc.GetState(&state, size);
+  ASSERT_EQ(0x55, state.r[1]);
+
+  // Underflows at 101, and after that reloads each 1001 cycles
+  ASSERT_EQ(1000 - (10000 - 101) % 1001, vc.ReadDW(0x11E000));
+}
+
+// Counts the CPU cycles given by the computer
+class CountingTR3200 : public trillek::computer::TR3200 {
+public:
+  CountingTR3200(unsigned clock) : TR3200(clock), cycles(0) { }
+
+  unsigned Tick (unsigned n = 1) override {
+    cycles += n;
+    return TR3200::Tick(n);
+  }
+
+  unsigned cycles;
+};
+
+TEST_F(VComputer_test, TR3200_SleepFastForward_Cycles) {
+  using namespace trillek::computer;
+  CountingTR3200* cpu = new CountingTR3200(250000); // A cycle each 4 ticks
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+
+  vc.WriteDW(0x001000, 0x00000000); // SLEEP
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x001000; // Interrupts disabled, so never wakes up
+  vc.SetState(&state, sizeof(state));
+  vc.Step();
+  ASSERT_TRUE(cpu->isSleeping());
+
+  vc.WriteDW(0x11E004, 0); // Underflows on each device cycle
+  vc.WriteB(0x11E010, 3);  // TMR0 on, with interrupts
+
+  // Each device event is a slice of 10 ticks, but the CPU must get the same
+  // cycles that without slices
+  cpu->cycles = 0;
+  vc.Tick(1000);
+  ASSERT_TRUE(cpu->isSleeping());
+  ASSERT_EQ(250u, cpu->cycles);
+  vc.Tick(1010);
+  ASSERT_EQ(250u + 252u, cpu->cycles);
+}
+
+TEST_F(VComputer_test, TR3200_CodeProfiler) {
+  using namespace trillek::computer;
+  TR3200* cpu = new TR3200();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.On();
+  cpu->SetJIT(true); // Not used while profiling
+  ASSERT_EQ(nullptr, cpu->GetCodeProfile());
+
+  vc.WriteDW(0x001000, 0x84800000 | (1 << 18) | (1 << 14) | 1); // ADD %r1, %r1, 1
+  vc.WriteDW(0x001004, 0x25800000 | (0x1000 >> 2));            // JMP 0x1000
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState(&state, size);
+  state.pc = 0x001000;
+  vc.SetState(&state, sizeof(state));
+
+  ASSERT_TRUE(cpu->SetCodeProfiling(true));
+  cpu->Tick(1000);
+  const CodeProfiler* prof = cpu->GetCodeProfile();
+  ASSERT_NE(nullptr, prof);
+  ASSERT_EQ(2, prof->Size());
+
+  vc.GetState(&state, size);
+  const CodeCounters add = prof->Get(0x001000);
+  const CodeCounters jmp = prof->Get(0x001004);
+  ASSERT_EQ(state.r[1], add.insts);
+  ASSERT_LE(jmp.insts, add.insts);
+  ASSERT_GE(jmp.insts + 1, add.insts);
+  ASSERT_EQ(add.cycles + jmp.cycles, prof->TotalCycles());
+  ASSERT_GE(prof->TotalCycles(), 1000);
+  ASSERT_EQ(0, prof->Get(0x001008).insts);
+
+  std::ostringstream report;
+  prof->WriteReport(report, [this] (trillek::DWord pc) {
+    return DisassemblyTR3200(vc, pc);
+  });
+  ASSERT_NE(std::string::npos, report.str().find("001000"));
+  ASSERT_NE(std::string::npos, report.str().find("ADD"));
+
+  ASSERT_FALSE(cpu->SetCodeProfiling(false));
+  ASSERT_EQ(nullptr, cpu->GetCodeProfile());
+}
+
+TEST_F(VComputer_test, TR3200_Disassembly) {
+  using namespace trillek::computer;
+  auto dis = [] (trillek::DWord inst, trillek::DWord next) {
+    const trillek::DWord code[2] = {inst, next};
+    return DisassemblyTR3200((const trillek::Byte*) code, 8);
+  };
+
+  ASSERT_EQ("ADD %r1, %r2, 0xFFFFFFFF", dis(0x8484BFFF, 0));
+  ASSERT_EQ("SUBB %r1, %r2, %r3", dis(0x87048003, 0));
+  ASSERT_EQ("STORE [%r2 + 0x12345678], %r1", dis(0x96C48000, 0x12345678));
+  ASSERT_EQ("STOREW [%r15 + 0xFFFFFFFF], %r15", dis(0x97FFC000, 0xFFFFFFFF));
+  ASSERT_EQ("LOADB %r1, [%r3]", dis(0x47040003, 0));
+  ASSERT_EQ("IFNEQ %r4, 0x00000010", dis(0x71900010, 0));
+  ASSERT_EQ("CALL %r1 + 0x00000040", dis(0x4C840010, 0));
+  ASSERT_EQ("POP %r5", dis(0x23000005, 0));
+  ASSERT_EQ("GETPC? 0x00000001", dis(0x22800001, 0));
+  ASSERT_EQ("JMP 0x00001000", dis(0x25800400, 0));
+  ASSERT_EQ("CALL %pc +0xFFFFFFF8", dis(0x28BFFFF8, 0));
+  ASSERT_EQ("INT 00000021h", dis(0x29800021, 0));
+  ASSERT_EQ("RFI", dis(0x02000000, 0));
+  // Unknow OpCodes
+  ASSERT_EQ("???? %r1, %r2, %r3", dis(0xA0048003, 0));
+  ASSERT_EQ("???? 0x00000007", dis(0x30800007, 0));
+  ASSERT_EQ("????", dis(0x10000000, 0));
+}
+
+TEST_F(VComputer_test, DCPU16N_FastMode) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+  using trillek::Word;
+
+  // Random code and data, so any addressing mode, skip chain and
+  // interrupt appears. Whole instructions against the phased engine
+  auto random_word = [] () -> Word {
+    Word w = std::rand();
+    if ((w & 0x1F) == 0x1C || (w & 0x1F) == 0x1D || (w & 0x3FF) == 0x200) {
+      w = (w & 0xFFE0) | 0x01; // Not HWW, HWR or MMW, so never reads the RNG
+    }
+    return w;
+  };
+  std::srand(4321);
+  std::vector<Byte> rom(32 * 1024);
+  for (unsigned i = 0; i < rom.size(); i += 2) {
+    const Word w = random_word();
+    rom[i] = w & 0xFF;
+    rom[i + 1] = w >> 8;
+  }
+  VComputer vc1(128 * 1024), vc2(128 * 1024);
+  VComputer* vms[2] = {&vc1, &vc2};
+  DCPU16N* fast_cpu = new DCPU16N();
+  DCPU16N* phased_cpu = new DCPU16N();
+  ASSERT_TRUE(fast_cpu->isFastMode());
+  phased_cpu->SetFastMode(false);
+  vc1.SetCPU(std::unique_ptr<ICPU>(fast_cpu));
+  vc2.SetCPU(std::unique_ptr<ICPU>(phased_cpu));
+  for (auto v : vms) {
+    v->SetROM(rom.data(), rom.size());
+    v->On();
+  }
+  for (unsigned i = 0; i < vc1.RamSize(); i += 2) {
+    const Word w = random_word();
+    vc1.WriteW(i, w);
+    vc2.WriteW(i, w);
+  }
+
+  DCPU16NState s1, s2;
+  for (unsigned step = 0; step < 3000; step++) {
+    if (std::rand() % 50 == 0) {
+      const Word msg = std::rand();
+      fast_cpu->SendInterrupt(msg);
+      phased_cpu->SendInterrupt(msg);
+    }
+    // Small chunks, so a lot of instructions not fit on a Tick
+    const unsigned ticks = 1 + std::rand() % (step % 10 == 0 ? 500 : 20);
+    ASSERT_EQ(fast_cpu->Tick(ticks), phased_cpu->Tick(ticks));
+
+    std::size_t size = sizeof(s1);
+    fast_cpu->GetState(&s1, size);
+    phased_cpu->GetState(&s2, size);
+    ASSERT_EQ(s1.pc, s2.pc) << "at step " << step;
+    ASSERT_EQ(s1.sp, s2.sp) << "at step " << step;
+    ASSERT_EQ(s1.ex, s2.ex) << "at step " << step;
+    for (unsigned i = 0; i < 8; i++) {
+      ASSERT_EQ(s1.r[i], s2.r[i]) << "r" << i << " at step " << step;
+    }
+    ASSERT_EQ(s1.phase, s2.phase) << "at step " << step;
+    ASSERT_EQ(s1.wait_cycles, s2.wait_cycles) << "at step " << step;
+    ASSERT_EQ(s1.pwrdraw, s2.pwrdraw) << "at step " << step;
+    ASSERT_EQ(s1.skip, s2.skip) << "at step " << step;
+    ASSERT_EQ(s1.iqc, s2.iqc) << "at step " << step;
+    ASSERT_EQ(0, std::memcmp(vc1.Ram(), vc2.Ram(), vc1.RamSize())) << "at step " << step;
+  }
+}
+
+TEST_F(VComputer_test, DCPU16N_BankCache) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+  using trillek::Word;
+
+  // Loop that stores A on 0x3000 and increments it
+  const Word code[] = {
+    0x03C1, 0x3000, // SET [0x3000], A
+    0x8802,         // ADD A, 1
+    0x8781,         // SET PC, 0
+  };
+  Byte rom[sizeof(code)];
+  for (unsigned i = 0; i < sizeof(code) / 2; i++) {
+    rom[i * 2] = code[i] & 0xFF;
+    rom[i * 2 + 1] = code[i] >> 8;
+  }
+  DCPU16N* cpu = new DCPU16N();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.SetROM(rom, sizeof(rom));
+  vc.On();
+
+  // Code and data pages are accessed by host pointers
+  cpu->Tick(1000);
+  const Word last = vc.ReadW(0x3000);
+  ASSERT_NE(0, last);
+
+  // A listener added after, changes the bus version, so the stores go by
+  // the bus again
+  TestAddrListener t_addr;
+  auto id = vc.AddAddrListener(Range(0x3000, 0x3001), &t_addr);
+  cpu->Tick(1000);
+  ASSERT_LT(0, t_addr.writeCount);
+  ASSERT_LT(last, vc.ReadW(0x3000));
+  ASSERT_TRUE(vc.RmAddrListener(id));
+
+  // Same with a watchpoint
+  cpu->Tick(1000);
+  vc.SetWatchPoint(0x3000, 2, VComputer::WATCH_WRITE);
+  ASSERT_FALSE(vc.isHalted());
+  cpu->Tick(1000);
+  ASSERT_TRUE(vc.isHalted());
+  ASSERT_EQ(0x3001, vc.LastWatchPoint()); // Stored byte by byte
+}
+
+TEST_F(VComputer_test, DCPU16N_SelfModifyingCode) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+  using trillek::Word;
+
+  const Word boot[] = {
+    0x7C21, 0x8842, // SET B, 0x8842 (ADD C, 1)
+    0x7F81, 0x1000, // SET PC, 0x1000
+  };
+  const Word loop[] = {
+    0x8802,         // ADD A, 1
+    0x07C1, 0x1000, // SET [0x1000], B
+    0x7F81, 0x1000, // SET PC, 0x1000
+  };
+  Byte rom[sizeof(boot)];
+  for (unsigned i = 0; i < sizeof(boot) / 2; i++) {
+    rom[i * 2] = boot[i] & 0xFF;
+    rom[i * 2 + 1] = boot[i] >> 8;
+  }
+  DCPU16N* cpu = new DCPU16N();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.SetROM(rom, sizeof(rom));
+  vc.On();
+  for (unsigned i = 0; i < sizeof(loop) / 2; i++) {
+    vc.WriteW(0x1000 + i * 2, loop[i]);
+  }
+
+  // The first pass replaces the cached ADD A, 1 with ADD C, 1
+  DCPU16NState state;
+  std::size_t size = sizeof(state);
+  cpu->Tick(1000);
+  cpu->GetState(&state, size);
+  ASSERT_EQ(1, state.r[0]);
+  ASSERT_LT(10, state.r[2]);
+
+  // Writes from outside of the CPU invalidate the cached opcode too
+  vc.WriteW(0x1000, 0x8802);
+  vc.WriteW(0x1002, 0x0001); // SET A, A
+  vc.WriteW(0x1004, 0x0001); // SET A, A
+  const Word c = state.r[2];
+  cpu->Tick(1000);
+  cpu->GetState(&state, size);
+  ASSERT_LT(10, state.r[0]);
+  ASSERT_GE(c + 1, state.r[2]); // Could be running ADD C, 1 when was replaced
+}
+
+TEST_F(VComputer_test, DCPU16N_UnwatchCode) {
+  using namespace trillek::computer;
+  using trillek::Byte;
+
+  const Byte rom[] = {0x81, 0x7F, 0x00, 0x30}; // SET PC, 0x3000
+  DCPU16N* cpu = new DCPU16N();
+  vc.SetCPU(std::unique_ptr<ICPU>(cpu));
+  vc.SetROM(rom, sizeof(rom));
+  vc.On();
+  vc.WriteW(0x3000, 0x8802); // ADD A, 1
+  vc.WriteW(0x3002, 0x7F81); // SET PC, 0x3000
+  vc.WriteW(0x3004, 0x3000);
+  cpu->Tick(1000);
+  std::size_t size = 0;
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size)); // Has cached code
+
+  // Overwriting the two cached opcodes lets the page be written directly
+  vc.WriteW(0x3000, 0x0001); // SET A, A
+  ASSERT_EQ(nullptr, vc.WritePointer(0x003000, size));
+  vc.WriteW(0x3002, 0x0001); // SET A, A
+  ASSERT_NE(nullptr, vc.WritePointer(0x003000, size));
+}
+
+TEST_F(VComputer_test, IOPorts) {
+  using namespace trillek::computer;
+  auto ddev = std::make_shared<DummyDevice>();
+  ASSERT_TRUE(vc.AddDevice(2, ddev));
+  TestAddrListener t_addr;
+  auto id = vc.AddAddrListener(Range(0x11A000, 0x11A00F), &t_addr);
+  TestAddrListener t_addr1, t_addr2; // Sharing a line
+  auto id1 = vc.AddAddrListener(Range(0x11B000, 0x11B003), &t_addr1);
+  auto id2 = vc.AddAddrListener(Range(0x11B004, 0x11B007), &t_addr2);
+
+  // The port table gives the same that the address decoder
+  for (unsigned port = 0x0000; port < 0x10000; port += 2) {
+    if (port >= 0xE03F && port <= 0xE043) {
+      continue; // The RNG gives other number on each read
+    }
+    ASSERT_EQ(vc.ReadW(IOPortBase + port), vc.ReadPort(port)) << "port " << port;
+  }
+  vc.WritePort(0x0208, 0xAF50);
+  ASSERT_EQ(0xAF50, vc.ReadPort(0x020A));
+  t_addr.writeCount = 0;
+  vc.WritePort(0xA00E, 0x1234);
+  vc.WritePort(0xA010, 0x1234); // Outside of the listener
+  ASSERT_EQ(2, t_addr.writeCount);
+  t_addr1.writeCount = t_addr2.writeCount = 0;
+  vc.WritePort(0xB002, 0x1234);
+  vc.WritePort(0xB004, 0x1234);
+  vc.WritePort(0xB008, 0x1234); // Same line, but outside of the listeners
+  ASSERT_EQ(2, t_addr1.writeCount);
+  ASSERT_EQ(2, t_addr2.writeCount);
+  ASSERT_TRUE(vc.RmAddrListener(id1));
+  ASSERT_TRUE(vc.RmAddrListener(id2));
+
+  // Removed listeners and devices are dropped from the table
+  ASSERT_TRUE(vc.RmAddrListener(id));
+  vc.RmDevice(2);
+  t_addr.writeCount = 0;
+  vc.WritePort(0xA00E, 0x1234);
+  ASSERT_EQ(0, t_addr.writeCount);
+  ASSERT_EQ(0, vc.ReadPort(0x0200));
+
+  // Watchpoints on the ports are still checked
+  vc.SetWatchPoint(0x11A000, 2, VComputer::WATCH_WRITE);
+  vc.WritePort(0xA000, 0x1234);
+  ASSERT_TRUE(vc.isHalted());
+}
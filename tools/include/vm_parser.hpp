@@ -35,6 +35,7 @@ struct VmParamaters {
         rom_file = nullptr;
         exec_vm = false;
         timing_debug = false;
+        code_profile = false;
         extentions = 0;
 
         cpu = CpuToUse::TR3200;
@@ -66,6 +67,9 @@ struct VmParamaters {
                 } else if(strncmp(arg, "-time", 5) == 0) {
                     timing_debug = true;
 
+                } else if(strncmp(arg, "-profile", 8) == 0) {
+                    code_profile = true;
+
                 } else if(strncmp(arg, "x", 1) == 0 || strncmp(arg, "-exec", 5) == 0) {
                     // Run VM parameter
                     exec_vm = true;
@@ -174,6 +178,7 @@ struct VmParamaters {
                     "\t-m val or --mem val : How much RAM the computer will have, in KiB."
                     " Must be between 32 and 1024 and will be rounded to a multiple of 32\n"
                     "\t--time : Show timing and speed info while running.\n"
+                    "\t--profile : Show the most executed guest code when exits.\n"
                     "\t--clock val : CPU clock speed in Khz. Must be 100, 250, 500 or 1000.\n"
                     "\t-b val : Inserts a breakpoint at address val (could be hexadecimal or decimal).\n"
                     "\t--ext-keys : Allow extra (non-standard) keycodes with virtual keyboard.\n"
@@ -209,6 +214,7 @@ struct VmParamaters {
     bool ask_help;                  /// User asked by help
     bool exec_vm;                   /// Run computer without asking to use debug mode
     bool timing_debug;              /// Print timing info while running
+    bool code_profile;              /// Print the code profile at exit
     unsigned extentions;            /// bit mask of extentions
 };
 
@@ -256,15 +256,21 @@ int main(int argc, char* argv[]) {
     nvram.seekg (0, std::ios::beg);
     vc.LoadNVRAM(nvram);
 
+    computer::ICPU* vcpu;
     if (options.cpu == CpuToUse::DCPU16N) {
         std::printf("Using CPU DCPU-16N\n");
         std::unique_ptr<computer::ICPU> cpu(new DCPU16N(options.clock) );
+        vcpu = cpu.get();
         vc.SetCPU(std::move(cpu));
     } else {
         std::printf("Using CPU TR3200\n");
         std::unique_ptr<computer::ICPU> cpu(new TR3200(options.clock) );
+        vcpu = cpu.get();
         vc.SetCPU(std::move(cpu));
     }
+    if (options.code_profile) {
+        vcpu->SetCodeProfiling(true);
+    }
     std::printf("CPU clock speed set to %u KHz \n", options.clock / 1000);
     vc.SetROM(rom, rom_size);
 
@@ -553,6 +559,16 @@ int main(int argc, char* argv[]) {
     nvram.seekg (0, std::ios::beg);
     vc.SaveNVRAM(nvram);
 
+    if (options.code_profile && vcpu->GetCodeProfile() != nullptr) {
+        std::printf("\nCode profile :\n");
+        vcpu->GetCodeProfile()->WriteReport(std::cout, [&] (DWord pc) {
+            if (options.cpu == CpuToUse::DCPU16N) {
+                return computer::DisassemblyDCPU16N(vc, pc);
+            }
+            return computer::DisassemblyTR3200(vc, pc);
+        });
+    }
+
     if (rom != nullptr) {
         delete[] rom;
     }